@@ -0,0 +1,90 @@
+#include <errno.h>
+#include <time.h>
+
+#include "ChangeLog.h"
+#include "dthread.h"
+
+using namespace std;
+
+ChangeLog::ChangeLog() {
+  pthread_mutex_init(&m_lock, NULL);
+  pthread_cond_init(&m_changed, NULL);
+  m_version = 0;
+}
+
+unsigned long ChangeLog::current() {
+  dthread_mutex_lock(&m_lock);
+  unsigned long version = m_version;
+  dthread_mutex_unlock(&m_lock);
+  return version;
+}
+
+unsigned long ChangeLog::record(string path) {
+  dthread_mutex_lock(&m_lock);
+  struct Change change;
+  change.version = ++m_version;
+  change.path = path;
+  m_log.push_back(change);
+  if (m_log.size() > CHANGE_LOG_ENTRIES) {
+    m_log.pop_front();
+  }
+  unsigned long version = m_version;
+  dthread_cond_broadcast(&m_changed);
+  dthread_mutex_unlock(&m_lock);
+
+  return version;
+}
+
+bool ChangeLog::waitForChange(string path, unsigned long since, int timeoutMs,
+			      unsigned long *latest, vector<string> *changed) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeoutMs / 1000;
+  deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  dthread_mutex_lock(&m_lock);
+  bool complete = true;
+  while (true) {
+    // versions the log has already dropped, or never handed out (the
+    // server restarted), can't be answered precisely
+    if ((m_log.size() > 0 && since + 1 < m_log.front().version) || since > m_version) {
+      complete = false;
+      break;
+    }
+    if (collect(path, since, changed)) {
+      break;
+    }
+    if (dthread_cond_timedwait(&m_changed, &m_lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  *latest = m_version;
+  dthread_mutex_unlock(&m_lock);
+
+  return complete;
+}
+
+// Must hold m_lock. The log is in version order, so only the tail can be
+// newer than since.
+bool ChangeLog::collect(string path, unsigned long since, vector<string> *changed) {
+  deque<struct Change>::reverse_iterator iter;
+  for (iter = m_log.rbegin(); iter != m_log.rend() && iter->version > since; iter++) {
+    if (isBelow(iter->path, path)) {
+      changed->insert(changed->begin(), iter->path);
+    }
+  }
+  return changed->size() > 0;
+}
+
+bool ChangeLog::isBelow(string changed, string watched) {
+  if (watched == "") {
+    return true;
+  }
+  return changed == watched ||
+    (changed.size() > watched.size() && changed.compare(0, watched.size(), watched) == 0 &&
+     changed[watched.size()] == '/');
+}
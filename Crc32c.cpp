@@ -0,0 +1,63 @@
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "Crc32c.h"
+
+// reflected form of the Castagnoli polynomial
+#define POLYNOMIAL (0x82F63B78)
+
+static uint32_t table[256];
+
+static void buildTable() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+    }
+    table[i] = crc;
+  }
+}
+
+static uint32_t software(uint32_t crc, const unsigned char *p, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t hardware(uint32_t crc, const unsigned char *p, size_t len) {
+  uint64_t crc64 = crc;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = (uint32_t) crc64;
+  for (; len > 0; p++, len--) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+  return crc;
+}
+#endif
+
+typedef uint32_t (*Implementation)(uint32_t, const unsigned char *, size_t);
+
+static Implementation choose() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return hardware;
+  }
+#endif
+  buildTable();
+  return software;
+}
+
+uint32_t Crc32c::checksum(const void *data, size_t len) {
+  static Implementation implementation = choose();
+  return ~implementation(~0U, (const unsigned char *) data, len);
+}
@@ -0,0 +1,78 @@
+#include <time.h>
+
+#include "Defragmenter.h"
+#include "FileSystemLock.h"
+#include "dthread.h"
+
+using namespace std;
+
+Defragmenter::Defragmenter(LocalFileSystem *fileSystem, pthread_mutex_t *lock, int blocksPerSecond) {
+  m_fileSystem = fileSystem;
+  m_lock = lock;
+  m_blocksPerSecond = blocksPerSecond;
+  m_cursor = 0;
+  m_moved = 0;
+}
+
+void Defragmenter::start() {
+  pthread_t thread;
+  dthread_create(&thread, NULL, run, this);
+  dthread_detach(thread);
+}
+
+unsigned long Defragmenter::moved() {
+  FileSystemLock guard(m_lock);
+  return m_moved;
+}
+
+void *Defragmenter::run(void *defragmenter) {
+  Defragmenter *self = (Defragmenter *) defragmenter;
+  while (true) {
+    bool passDone = false;
+    int moved = self->step(&passDone);
+
+    // spend the I/O budget: a moved block was read once and written once
+    long long sleepMs = (long long) moved * 1000 / self->m_blocksPerSecond;
+    if (passDone) {
+      sleepMs = DEFRAG_IDLE_MS;
+    }
+    if (sleepMs > 0) {
+      struct timespec pause;
+      pause.tv_sec = sleepMs / 1000;
+      pause.tv_nsec = (sleepMs % 1000) * 1000000;
+      nanosleep(&pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+// move at most one file, returns the number of blocks it had
+int Defragmenter::step(bool *passDone) {
+  FileSystemLock guard(m_lock);
+  Disk *disk = m_fileSystem->disk;
+
+  super_t super;
+  m_fileSystem->readSuperBlock(&super);
+
+  for (int scanned = 0; scanned < DEFRAG_SCAN_INODES; scanned++) {
+    if (m_cursor >= super.num_inodes) {
+      m_cursor = 0;
+      *passDone = true;
+      return 0;
+    }
+    int inodeNumber = m_cursor++;
+
+    disk->beginTransaction();
+    int moved = m_fileSystem->relocate(inodeNumber);
+    if (moved < 0) {
+      disk->rollback();
+      continue;
+    }
+    disk->commit();
+    if (moved > 0) {
+      m_moved += moved;
+      return moved;
+    }
+  }
+  return 0;
+}
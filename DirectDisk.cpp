@@ -0,0 +1,153 @@
+#include <errno.h>
+#include <iostream>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DirectDisk.h"
+
+using namespace std;
+
+DirectDisk::DirectDisk(string imageFile, int blockSize, int cacheBlocks) : Disk(imageFile, blockSize) {
+  this->fd = open(imageFile.c_str(), O_RDWR | O_DIRECT);
+  if (this->fd < 0 && errno == EINVAL) {
+    cerr << "O_DIRECT is not supported for " << imageFile << ", using the page cache" << endl;
+    this->fd = open(imageFile.c_str(), O_RDWR);
+  }
+  if (this->fd < 0) {
+    cerr << "could not open " << imageFile << endl;
+    exit(1);
+  }
+
+  this->cacheBlocks = max(cacheBlocks, 0);
+  this->hits = 0;
+  this->misses = 0;
+  // aligned to the block size, which covers the device's sector size
+  if (posix_memalign((void **) &this->slots, blockSize, (size_t) max(this->cacheBlocks, 1) * blockSize) != 0 ||
+      posix_memalign((void **) &this->staging, blockSize, (size_t) DIRECT_RUN_BLOCKS * blockSize) != 0) {
+    cerr << "Could not allocate the block cache" << endl;
+    exit(1);
+  }
+  slotBlock.assign(this->cacheBlocks, -1);
+  for (int slot = 0; slot < this->cacheBlocks; slot++) {
+    recencyOf.push_back(recency.insert(recency.end(), slot));
+  }
+}
+
+DirectDisk::~DirectDisk() {
+  close(fd);
+  free(slots);
+  free(staging);
+}
+
+// the cached copy of a block, or NULL
+unsigned char *DirectDisk::lookup(int blockNumber) {
+  map<int, int>::iterator entry = cached.find(blockNumber);
+  if (entry == cached.end()) {
+    misses++;
+    return NULL;
+  }
+  hits++;
+  recency.splice(recency.begin(), recency, recencyOf[entry->second]);
+  return slots + (size_t) entry->second * blockSize;
+}
+
+// cache a block's current contents, in place of the least recently used one
+void DirectDisk::remember(int blockNumber, const unsigned char *data) {
+  if (cacheBlocks == 0) {
+    return;
+  }
+  int slot;
+  map<int, int>::iterator entry = cached.find(blockNumber);
+  if (entry != cached.end()) {
+    slot = entry->second;
+  } else {
+    slot = recency.back();
+    if (slotBlock[slot] >= 0) {
+      cached.erase(slotBlock[slot]);
+    }
+    slotBlock[slot] = blockNumber;
+    cached[blockNumber] = slot;
+  }
+  recency.splice(recency.begin(), recency, recencyOf[slot]);
+  memcpy(slots + (size_t) slot * blockSize, data, blockSize);
+}
+
+// move count blocks between the staging buffer and the image
+void DirectDisk::transfer(bool write, int firstBlock, int count) {
+  ssize_t length = (ssize_t) count * blockSize;
+  off_t offset = (off_t) firstBlock * blockSize;
+  ssize_t ret = write ? pwrite(fd, staging, length, offset) : pread(fd, staging, length, offset);
+  if (ret != length) {
+    cerr << (write ? "Could not write file" : "Could not read file") << endl;
+    exit(1);
+  }
+}
+
+void DirectDisk::readRaw(int blockNumber, void *buffer) {
+  unsigned char *block = lookup(blockNumber);
+  if (block == NULL) {
+    transfer(false, blockNumber, 1);
+    remember(blockNumber, staging);
+    block = staging;
+  }
+  memcpy(buffer, block, blockSize);
+}
+
+void DirectDisk::writeRaw(int blockNumber, const void *buffer) {
+  memcpy(staging, buffer, blockSize);
+  transfer(true, blockNumber, 1);
+  remember(blockNumber, staging);
+}
+
+// cached blocks are copied out, the rest are read a run of adjacent
+// blocks at a time
+void DirectDisk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  vector<int> missing;
+  vector<int> missingBlocks;
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    unsigned char *block = lookup(blockNumbers[i]);
+    if (block != NULL) {
+      memcpy(buffer + i * blockSize, block, blockSize);
+    } else {
+      missing.push_back(i);
+      missingBlocks.push_back(blockNumbers[i]);
+    }
+  }
+
+  vector<pair<int, int> > batchRuns = runs(missingBlocks);
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    for (int done = 0; done < batchRuns[i].second; done += DIRECT_RUN_BLOCKS) {
+      int first = batchRuns[i].first + done;
+      int count = min(batchRuns[i].second - done, DIRECT_RUN_BLOCKS);
+      transfer(false, missingBlocks[first], count);
+      for (int j = 0; j < count; j++) {
+	unsigned char *block = staging + (size_t) j * blockSize;
+	memcpy(buffer + (size_t) missing[first + j] * blockSize, block, blockSize);
+	remember(missingBlocks[first + j], block);
+      }
+    }
+  }
+}
+
+void DirectDisk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    for (int done = 0; done < batchRuns[i].second; done += DIRECT_RUN_BLOCKS) {
+      int first = batchRuns[i].first + done;
+      int count = min(batchRuns[i].second - done, DIRECT_RUN_BLOCKS);
+      memcpy(staging, buffer + (size_t) first * blockSize, (size_t) count * blockSize);
+      transfer(true, blockNumbers[first], count);
+      for (int j = 0; j < count; j++) {
+	remember(blockNumbers[first + j], staging + (size_t) j * blockSize);
+      }
+    }
+  }
+}
+
+// O_DIRECT skips the page cache but not the device's write cache
+void DirectDisk::sync() {
+  fsync(fd);
+}
@@ -3,12 +3,14 @@
 
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 
+#include "Crc32c.h"
 #include "Disk.h"
 #include "dthread.h"
 
@@ -18,6 +20,9 @@ Disk::Disk(string imageFile, int blockSize) {
   this->imageFile = imageFile;
   this->blockSize = blockSize;
   this->isInTransaction = false;
+  this->checksumAddr = 0;
+  this->checksumLen = 0;
+  this->mismatches = 0;
   
   struct stat stat;
   int imageFileDescriptor = open(imageFile.c_str(), O_RDONLY);
@@ -44,31 +49,169 @@ Disk::Disk(string imageFile, int blockSize) {
   
 }
 
+Disk::Disk(string imageFile, int blockSize, off_t imageFileSize) {
+  this->imageFile = imageFile;
+  this->blockSize = blockSize;
+  this->imageFileSize = imageFileSize;
+  this->isInTransaction = false;
+  this->checksumAddr = 0;
+  this->checksumLen = 0;
+  this->mismatches = 0;
+}
+
+Disk::~Disk() {
+  releaseUndoLog();
+  for (size_t i = 0; i < undoPool.size(); i++) {
+    delete [] undoPool[i];
+  }
+}
+
 int Disk::numberOfBlocks() {
   return this->imageFileSize / this->blockSize;
 }
 
+void Disk::grow(int numberOfBlocks) {
+  if (numberOfBlocks <= this->numberOfBlocks()) {
+    return;
+  }
+  off_t size = (off_t) numberOfBlocks * this->blockSize;
+  extend(size);
+  this->imageFileSize = size;
+  if (checksumAddr != 0) {
+    verify.resize(numberOfBlocks, true);
+  }
+}
+
+void Disk::extend(off_t size) {
+  if (truncate(this->imageFile.c_str(), size) != 0) {
+    perror("grow::truncate");
+    cerr << "Could not grow image file " << this->imageFile << endl;
+    exit(1);
+  }
+}
+
 void Disk::readBlock(int blockNumber, void *buffer) {
   if (blockNumber < 0 || blockNumber >= this->numberOfBlocks()) {
     cerr << "Invalid block number " << blockNumber << endl;
     exit(1);
   }
 
+  readRaw(blockNumber, buffer);
+  checkBlock(blockNumber, buffer);
+}
+
+void Disk::readBlocks(const vector<int> &blockNumbers, void *buffer) {
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    if (blockNumbers[i] < 0 || blockNumbers[i] >= this->numberOfBlocks()) {
+      cerr << "Invalid block number " << blockNumbers[i] << endl;
+      exit(1);
+    }
+  }
+
+  unsigned char *blocks = (unsigned char *) buffer;
+  readRawBlocks(blockNumbers, blocks);
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    checkBlock(blockNumbers[i], blocks + i * this->blockSize);
+  }
+}
+
+void Disk::checkBlock(int blockNumber, const void *buffer) {
+  if (hasChecksum(blockNumber) && verify[blockNumber] && checksums[blockNumber] != 0 &&
+      checksums[blockNumber] != Crc32c::checksum(buffer, this->blockSize)) {
+    mismatches++;
+    cerr << "Checksum mismatch in block " << blockNumber << endl;
+  }
+}
+
+void Disk::writeBlock(int blockNumber, void *buffer) {  
+  if (blockNumber < 0 || blockNumber >= this->numberOfBlocks()) {
+    cerr << "Invalid block number " << blockNumber << endl;
+    exit(1);
+  }
+
+  if (isInTransaction && loggedBlocks.insert(blockNumber).second) {
+    struct UndoRecord undoRecord;
+    undoRecord.blockNumber = blockNumber;
+    undoRecord.blockData = undoBuffer();
+    this->readBlock(blockNumber, undoRecord.blockData);
+    undoLog.push_front(undoRecord);
+  }
+  
+  writeRaw(blockNumber, buffer);
+  updateChecksum(blockNumber, buffer);
+
+  if (!isInTransaction) {
+    sync();
+  }
+}
+
+void Disk::writeBlocks(const vector<int> &blockNumbers, const void *buffer) {
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    if (blockNumbers[i] < 0 || blockNumbers[i] >= this->numberOfBlocks()) {
+      cerr << "Invalid block number " << blockNumbers[i] << endl;
+      exit(1);
+    }
+  }
+
+  // the contents before the batch, of the blocks without a record yet
+  if (isInTransaction) {
+    vector<int> unlogged;
+    for (size_t i = 0; i < blockNumbers.size(); i++) {
+      if (loggedBlocks.insert(blockNumbers[i]).second) {
+	unlogged.push_back(blockNumbers[i]);
+      }
+    }
+    vector<unsigned char> before(unlogged.size() * this->blockSize);
+    this->readBlocks(unlogged, before.data());
+    for (size_t i = 0; i < unlogged.size(); i++) {
+      struct UndoRecord undoRecord;
+      undoRecord.blockNumber = unlogged[i];
+      undoRecord.blockData = undoBuffer();
+      memcpy(undoRecord.blockData, &before[i * this->blockSize], this->blockSize);
+      undoLog.push_front(undoRecord);
+    }
+  }
+
+  const unsigned char *blocks = (const unsigned char *) buffer;
+  writeRawBlocks(blockNumbers, blocks);
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    updateChecksum(blockNumbers[i], blocks + i * this->blockSize);
+  }
+
+  if (!isInTransaction) {
+    sync();
+  }
+}
+
+void Disk::updateChecksum(int blockNumber, const void *buffer) {
+  if (!hasChecksum(blockNumber)) {
+    return;
+  }
+  checksums[blockNumber] = Crc32c::checksum(buffer, this->blockSize);
+  int tableBlock = blockNumber / (this->blockSize / sizeof(uint32_t));
+  if (isInTransaction) {
+    dirtyChecksumBlocks.insert(tableBlock);
+  } else {
+    writeChecksumBlock(tableBlock);
+  }
+}
+
+// the image file is opened for every access, so nothing is held open
+void Disk::readRaw(int blockNumber, void *buffer) {
   int fd = open(this->imageFile.c_str(), O_RDONLY);
   if (fd < 0) {
     cerr << "Could not open image file " << this->imageFile << endl;
     exit(1);
   }
 
-  int offset = blockNumber * this->blockSize;
-  int ret = lseek(fd, offset, SEEK_SET);
-  if (ret != offset) {
+  off_t offset = (off_t) blockNumber * this->blockSize;
+  if (lseek(fd, offset, SEEK_SET) != offset) {
     perror("read::lseek");
     cerr << "Could not seek to file" << endl;
     exit(1);
   }
 
-  ret = read(fd, buffer, this->blockSize);
+  int ret = read(fd, buffer, this->blockSize);
   if (ret != this->blockSize) {
     cerr << "Could not read file" << endl;
     exit(1);
@@ -77,40 +220,92 @@ void Disk::readBlock(int blockNumber, void *buffer) {
   close(fd);
 }
 
-void Disk::writeBlock(int blockNumber, void *buffer) {  
-  if (blockNumber < 0 || blockNumber >= this->numberOfBlocks()) {
-    cerr << "Invalid block number " << blockNumber << endl;
+// Batches land in consecutive slots of one buffer, so a run of adjacent
+// blocks is a single pread into consecutive memory. The kernel hears about
+// every run before the first pread waits, so it reads the later ones
+// while the earlier ones are copied.
+void Disk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  if (blockNumbers.empty()) {
+    return;
+  }
+  int fd = open(this->imageFile.c_str(), O_RDONLY);
+  if (fd < 0) {
+    cerr << "Could not open image file " << this->imageFile << endl;
     exit(1);
   }
 
-  if (isInTransaction) {
-    struct UndoRecord undoRecord;
-    undoRecord.blockNumber = blockNumber;
-    undoRecord.blockData = new unsigned char[blockSize];
-    this->readBlock(blockNumber, undoRecord.blockData);
-    undoLog.push_front(undoRecord);
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 1; i < batchRuns.size(); i++) {
+    posix_fadvise(fd, (off_t) blockNumbers[batchRuns[i].first] * this->blockSize,
+		  (off_t) batchRuns[i].second * this->blockSize, POSIX_FADV_WILLNEED);
   }
-  
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    ssize_t length = (ssize_t) batchRuns[i].second * this->blockSize;
+    off_t offset = (off_t) blockNumbers[batchRuns[i].first] * this->blockSize;
+    if (pread(fd, buffer + (size_t) batchRuns[i].first * this->blockSize, length, offset) != length) {
+      cerr << "Could not read file" << endl;
+      exit(1);
+    }
+  }
+
+  close(fd);
+}
+
+void Disk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  if (blockNumbers.empty()) {
+    return;
+  }
+  int fd = open(this->imageFile.c_str(), O_RDWR);
+  if (fd < 0) {
+    cerr << "Could not open image file " << this->imageFile << endl;
+    exit(1);
+  }
+
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    ssize_t length = (ssize_t) batchRuns[i].second * this->blockSize;
+    off_t offset = (off_t) blockNumbers[batchRuns[i].first] * this->blockSize;
+    if (pwrite(fd, buffer + (size_t) batchRuns[i].first * this->blockSize, length, offset) != length) {
+      cerr << "Could not write file" << endl;
+      exit(1);
+    }
+  }
+
+  close(fd);
+}
+
+vector<pair<int, int> > Disk::runs(const vector<int> &blockNumbers) {
+  vector<pair<int, int> > result;
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    if (!result.empty() && blockNumbers[i] == blockNumbers[i - 1] + 1) {
+      result.back().second++;
+    } else {
+      result.push_back(make_pair((int) i, 1));
+    }
+  }
+  return result;
+}
+
+void Disk::writeRaw(int blockNumber, const void *buffer) {
   int fd = open(this->imageFile.c_str(), O_RDWR);
   if (fd < 0) {
     cerr << "Could not open image file " << this->imageFile << endl;
     exit(1);
   }
 
-  int offset = blockNumber * this->blockSize;
-  int ret = lseek(fd, offset, SEEK_SET);
-  if (ret != offset) {
+  off_t offset = (off_t) blockNumber * this->blockSize;
+  if (lseek(fd, offset, SEEK_SET) != offset) {
     perror("write::lseek");
     cerr << "Could not seek to file" << endl;
     exit(1);
   }
 
-  ret = write(fd, buffer, this->blockSize);
+  int ret = write(fd, buffer, this->blockSize);
   if (ret != this->blockSize) {
     cerr << "Could not write file" << endl;
     exit(1);
   }
-  fsync(fd);
+
   close(fd);
 }
 
@@ -124,11 +319,15 @@ void Disk::beginTransaction() {
 
 void Disk::commit() {
   isInTransaction = false;
-  deque<struct UndoRecord>::iterator iter;
-  for (iter = undoLog.begin(); iter != undoLog.end(); iter++) {
-    delete [] iter->blockData;
+  set<int>::iterator tableBlock;
+  for (tableBlock = dirtyChecksumBlocks.begin(); tableBlock != dirtyChecksumBlocks.end(); tableBlock++) {
+    writeChecksumBlock(*tableBlock);
   }
-  undoLog.clear();
+  dirtyChecksumBlocks.clear();
+  if (!undoLog.empty()) {
+    sync();
+  }
+  releaseUndoLog();
 }
 
 void Disk::rollback() {
@@ -136,7 +335,126 @@ void Disk::rollback() {
   deque<struct UndoRecord>::iterator iter;
   for (iter = undoLog.begin(); iter != undoLog.end(); iter++) {
     this->writeBlock(iter->blockNumber, iter->blockData);
-    delete [] iter->blockData;
+  }
+  releaseUndoLog();
+  // restoring the blocks wrote their old checksums back already
+  dirtyChecksumBlocks.clear();
+}
+
+// writes after the savepoint need their own records, to undo back to it
+int Disk::savepoint() {
+  loggedBlocks.clear();
+  return undoLog.size();
+}
+
+void Disk::rollbackTo(int savepoint) {
+  // the newest undo records are at the front
+  isInTransaction = false;
+  while ((int) undoLog.size() > savepoint) {
+    struct UndoRecord undoRecord = undoLog.front();
+    undoLog.pop_front();
+    this->writeBlock(undoRecord.blockNumber, undoRecord.blockData);
+    releaseUndoBuffer(undoRecord.blockData);
+  }
+  // which blocks still have a record since the savepoint before this one
+  // isn't known, so the next writes log them again
+  loggedBlocks.clear();
+  isInTransaction = true;
+}
+
+unsigned char *Disk::undoBuffer() {
+  if (undoPool.empty()) {
+    return new unsigned char[blockSize];
+  }
+  unsigned char *buffer = undoPool.back();
+  undoPool.pop_back();
+  return buffer;
+}
+
+void Disk::releaseUndoBuffer(unsigned char *buffer) {
+  if (undoPool.size() < UNDO_POOL_BLOCKS) {
+    undoPool.push_back(buffer);
+  } else {
+    delete [] buffer;
+  }
+}
+
+void Disk::releaseUndoLog() {
+  deque<struct UndoRecord>::iterator iter;
+  for (iter = undoLog.begin(); iter != undoLog.end(); iter++) {
+    releaseUndoBuffer(iter->blockData);
   }
   undoLog.clear();
+  loggedBlocks.clear();
+}
+
+void Disk::sync() {
+  int fd = open(this->imageFile.c_str(), O_RDWR);
+  if (fd < 0) {
+    cerr << "Could not open image file " << this->imageFile << endl;
+    exit(1);
+  }
+  fsync(fd);
+  close(fd);
+}
+
+void Disk::enableChecksums(int tableAddr, int tableLen) {
+  if (checksumAddr == tableAddr) {
+    return;
+  }
+  int entriesPerBlock = this->blockSize / sizeof(uint32_t);
+  checksums.assign(tableLen * entriesPerBlock, 0);
+  for (int i = 0; i < tableLen; i++) {
+    this->readBlock(tableAddr + i, &checksums[i * entriesPerBlock]);
+  }
+  verify.assign(numberOfBlocks(), true);
+  checksumAddr = tableAddr;
+  checksumLen = tableLen;
+}
+
+void Disk::moveChecksums(int tableAddr, int tableLen) {
+  int entriesPerBlock = this->blockSize / sizeof(uint32_t);
+  checksums.resize(tableLen * entriesPerBlock, 0);
+  // the table never covers itself, and the old one's blocks start over
+  // unchecked like any other fresh block
+  for (int i = 0; i < checksumLen; i++) {
+    checksums[checksumAddr + i] = 0;
+  }
+  for (int i = 0; i < tableLen; i++) {
+    checksums[tableAddr + i] = 0;
+  }
+  checksumAddr = tableAddr;
+  checksumLen = tableLen;
+
+  if (isInTransaction) {
+    for (int tableBlock = 0; tableBlock < tableLen; tableBlock++) {
+      dirtyChecksumBlocks.insert(tableBlock);
+    }
+    return;
+  }
+  for (int tableBlock = 0; tableBlock < tableLen; tableBlock++) {
+    writeChecksumBlock(tableBlock);
+  }
+  sync();
+}
+
+void Disk::verifyChecksums(int firstBlock, int count, bool enabled) {
+  for (int i = firstBlock; i < firstBlock + count && i < (int) verify.size(); i++) {
+    verify[i] = enabled;
+  }
+}
+
+unsigned long Disk::checksumMismatches() {
+  return mismatches;
+}
+
+// the table doesn't cover itself
+bool Disk::hasChecksum(int blockNumber) {
+  return checksumAddr != 0 && (blockNumber < checksumAddr || blockNumber >= checksumAddr + checksumLen) &&
+    blockNumber < (int) checksums.size();
+}
+
+void Disk::writeChecksumBlock(int tableBlock) {
+  int entriesPerBlock = this->blockSize / sizeof(uint32_t);
+  writeRaw(checksumAddr + tableBlock, &checksums[tableBlock * entriesPerBlock]);
 }
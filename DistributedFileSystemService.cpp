@@ -7,18 +7,51 @@
 #include <map>
 #include <string>
 #include <algorithm>
+#include <climits>
 
 #include "DistributedFileSystemService.h"
 #include "ClientError.h"
 #include "ufs.h"
 #include "WwwFormEncodedDict.h"
+#include "StringUtils.h"
+#include "HttpUtils.h"
+#include "dthread.h"
+#include "FileSystemLock.h"
 
 using namespace std;
 
 // constructor
-DistributedFileSystemService::DistributedFileSystemService(string diskFile)
+DistributedFileSystemService::DistributedFileSystemService(Disk *disk)
     : HttpService("/ds3/") {
-  this->fileSystem = new LocalFileSystem(new Disk(diskFile, UFS_BLOCK_SIZE));
+  this->fileSystem = new LocalFileSystem(disk);
+  this->replicas = NULL;
+  this->leases = NULL;
+  this->changes = new ChangeLog();
+  this->defragmenter = NULL;
+  pthread_mutex_init(&this->lock, NULL);
+  pthread_mutex_init(&this->watchLock, NULL);
+  this->watchers = 0;
+  this->maxWatchers = INT_MAX;
+}
+
+void DistributedFileSystemService::limitWatchers(int maxWatchers) {
+  this->maxWatchers = maxWatchers;
+}
+
+void DistributedFileSystemService::enableLeases(int leaseMs) {
+  this->leases = new LeaseTable(leaseMs);
+}
+
+void DistributedFileSystemService::enableDefragmentation(int blocksPerSecond) {
+  this->defragmenter = new Defragmenter(fileSystem, &lock, blocksPerSecond);
+  this->defragmenter->start();
+}
+
+void DistributedFileSystemService::enableReplication(string nodeId, vector<string> peers, int timeoutMs,
+						     string secret) {
+  this->nodeId = nodeId;
+  this->replicaSecret = secret;
+  this->replicas = new ReplicaSet(peers, timeoutMs);
 }
 
 // GET Method - read files or list directory
@@ -26,6 +59,112 @@ void DistributedFileSystemService::get(HTTPRequest *request, HTTPResponse *respo
   string path = request->getPath();
   path = path.substr(5); // remove /ds3/
 
+  map<string, string> params = queryParams(request);
+
+  // lease holders poll for revocations with ?invalidations=<seq>
+  if (leases != NULL && params.find("invalidations") != params.end()) {
+    invalidations(strtoul(params["invalidations"].c_str(), NULL, 10), response);
+    return;
+  }
+
+  // ?watch=<version>[&timeout=<ms>] blocks until something below path changes
+  if (params.find("watch") != params.end()) {
+    int timeoutMs = WATCH_DEFAULT_TIMEOUT_MS;
+    if (params.find("timeout") != params.end()) {
+      timeoutMs = max(0, min(atoi(params["timeout"].c_str()), WATCH_MAX_TIMEOUT_MS));
+    }
+    watch(path, strtoul(params["watch"].c_str(), NULL, 10), timeoutMs, response);
+    return;
+  }
+
+  // Granted before reading, so a write that lands after the read revokes
+  // this lease. Granted after, the revocation could come first and find
+  // no lease, and the client would keep the old contents for the TTL.
+  string lease;
+  if (leases != NULL && !isReplicaRequest(request)) {
+    lease = leases->grant(pathKey(path));
+  }
+
+  if (replicas != NULL && !isReplicaRequest(request)) {
+    // client requests fan out to the other replicas in replicated mode
+    coordinatedGet(path, request, response);
+  } else {
+    FileSystemLock guard(&lock);
+    bool isDirectory;
+    string body = readPath(fileSystem, path, &isDirectory);
+
+    // let the coordinator know which version of the file we hold
+    map<string, VersionVector>::iterator version = versions.find(pathKey(path));
+    if (!isDirectory && version != versions.end()) {
+      response->setHeader(VERSION_HEADER, version->second.toString());
+    }
+
+    // watchers continue from the version this listing reflects
+    stringstream watchVersion;
+    watchVersion << changes->current();
+    response->setHeader(WATCH_VERSION_HEADER, watchVersion.str());
+
+    response->setBody(body);
+  }
+
+  if (!lease.empty()) {
+    response->setHeader(LEASE_HEADER, lease);
+  }
+}
+
+// the revocation log after sequence number since, one path per line after
+// the newest sequence number. 205 tells the client to drop its whole cache.
+void DistributedFileSystemService::invalidations(unsigned long since, HTTPResponse *response) {
+  unsigned long latest;
+  vector<string> paths;
+  bool complete = leases->revokedSince(since, &latest, &paths);
+
+  stringstream body;
+  body << latest << "\n";
+  for (size_t idx = 0; idx < paths.size(); idx++) {
+    body << paths[idx] << "\n";
+  }
+
+  response->setStatus(complete ? 200 : 205);
+  response->setBody(body.str());
+}
+
+// the paths below path that changed after version since, one per line
+// after the newest version. 205 tells the watcher to re-read the listing.
+void DistributedFileSystemService::watch(string path, unsigned long since, int timeoutMs,
+					 HTTPResponse *response) {
+  dthread_mutex_lock(&watchLock);
+  bool full = watchers >= maxWatchers;
+  if (!full) {
+    watchers++;
+  }
+  dthread_mutex_unlock(&watchLock);
+  if (full) {
+    throw ClientError::serviceUnavailable();
+  }
+
+  unsigned long latest;
+  vector<string> changed;
+  bool complete = changes->waitForChange(pathKey(path), since, timeoutMs, &latest, &changed);
+  dthread_mutex_lock(&watchLock);
+  watchers--;
+  dthread_mutex_unlock(&watchLock);
+
+  stringstream body;
+  body << latest << "\n";
+  for (size_t idx = 0; idx < changed.size(); idx++) {
+    body << changed[idx] << "\n";
+  }
+
+  stringstream watchVersion;
+  watchVersion << latest;
+  response->setHeader(WATCH_VERSION_HEADER, watchVersion.str());
+  response->setStatus(complete ? 200 : 205);
+  response->setBody(body.str());
+}
+
+// read a file, or list a directory, from the local file system
+string DistributedFileSystemService::readPath(LocalFileSystem *fileSystem, string path, bool *isDirectory) {
   // remove trailing slash for consistency
   if (!path.empty() && path.back() == '/') {
     path.pop_back();
@@ -59,6 +198,7 @@ void DistributedFileSystemService::get(HTTPRequest *request, HTTPResponse *respo
     fileSystem->stat(parent, &inodeData);
 
     // handle directories
+    *isDirectory = (inodeData.type == UFS_DIRECTORY);
     if (inodeData.type == UFS_DIRECTORY) {
       // read directory contents
       unsigned char buffer[inodeData.size];
@@ -91,7 +231,7 @@ void DistributedFileSystemService::get(HTTPRequest *request, HTTPResponse *respo
         result << entry << "\n";
       }
 
-      response->setBody(result.str());
+      return result.str();
     } else {
       // handle files
       unsigned char buffer[inodeData.size];
@@ -101,7 +241,7 @@ void DistributedFileSystemService::get(HTTPRequest *request, HTTPResponse *respo
       }
 
       // send file content
-      response->setBody(string(reinterpret_cast<char *>(buffer), inodeData.size));
+      return string(reinterpret_cast<char *>(buffer), inodeData.size);
     }
   } catch (const ClientError &e) {
     throw; // rethrow known errors
@@ -117,133 +257,663 @@ void DistributedFileSystemService::put(HTTPRequest *request, HTTPResponse *respo
   path = path.substr(5); // remove /ds3/
   string body = request->getBody(); // file contents
 
+  if (isReplicaRequest(request)) {
+    // a write (or read repair) from a coordinator, only apply it if it is
+    // newer than the copy we already hold
+    string key = pathKey(path);
+    VersionVector incoming = VersionVector::parse(optionalHeader(request, VERSION_HEADER));
+    FileSystemLock guard(&lock);
+    VersionVector &local = versions[key];
+    if (incoming.newerThan(local)) {
+      writePath(path, body);
+    }
+    local.merge(incoming);
+    response->setHeader(VERSION_HEADER, local.toString());
+    response->setStatus(200);
+    return;
+  }
+
+  if (replicas != NULL) {
+    coordinatedPut(path, request, response);
+    return;
+  }
+
+  FileSystemLock guard(&lock);
+  writePath(path, body);
+  response->setStatus(200);
+}
+
+// create or overwrite a file, or create a directory, in the local file system
+void DistributedFileSystemService::writePath(string path, string body) {
   try {
     // begin transaction
     Disk *disk = fileSystem->disk; 
     disk->beginTransaction();
 
-    // tokenize path
-    vector<string> tokens;
-    stringstream ss(path);
-    string item;
-    while (getline(ss, item, '/')) {
-      if (!item.empty()) tokens.push_back(item);
+    map<string, int> directories;
+    applyPut(path, body, &directories);
+
+    // commit transaction if successful
+    disk->commit();
+    changes->record(pathKey(path));
+    if (leases != NULL) {
+      leases->revoke(pathKey(path));
     }
 
-    int parent = 0; // start at root directory
-    bool isDirectory = path.back() == '/'; // check if the target is a directory
+  } catch (...) {
+    // rollback on any failure
+    fileSystem->disk->rollback();
+    throw ClientError::badRequest();
+  }
+}
 
-    // traverse intermediate directories
-    for (size_t i = 0; i < tokens.size() - 1; i++) {
-      int inode = fileSystem->lookup(parent, tokens[i]);
-      if (inode < 0) {
-        parent = fileSystem->create(parent, UFS_DIRECTORY, tokens[i]);
+// DELETE Method - delete files or directories
+void DistributedFileSystemService::del(HTTPRequest *request, HTTPResponse *response) {
+  string path = request->getPath(); // get path from request
+  path = path.substr(5);            // remove "/ds3/"
+
+  if (replicas != NULL) {
+    // a delete leaves no version behind, so read repair would bring the
+    // file back from a replica that still has it
+    throw ClientError::badRequest();
+  }
+
+  FileSystemLock guard(&lock);
+  try {
+    // begin transaction
+    Disk *disk = fileSystem->disk;
+    disk->beginTransaction();
+
+    map<string, int> directories;
+    applyDelete(path, &directories);
+
+    // commit Transaction
+    disk->commit();
+    versions.erase(pathKey(path));
+    changes->record(pathKey(path));
+    if (leases != NULL) {
+      leases->revoke(pathKey(path));
+    }
+    response->setStatus(200); // success
+  }
+  catch (const ClientError &e) {
+    fileSystem->disk->rollback();
+    throw; // rethrow known errors
+  }
+  catch (const exception &e) {
+    fileSystem->disk->rollback();
+    throw ClientError::badRequest(); // catch unexpected errors
+  }
+}
+
+// MOVE Method - rename a file or directory to the path in the Destination header
+void DistributedFileSystemService::move(HTTPRequest *request, HTTPResponse *response) {
+  string path = request->getPath().substr(5); // remove /ds3/
+  string destination = destinationPath(request);
+
+  if (replicas != NULL) {
+    // the version vectors would not follow the data to the new path
+    throw ClientError::badRequest();
+  }
+
+  vector<string> srcTokens = StringUtils::split(path, '/');
+  vector<string> dstTokens = StringUtils::split(destination, '/');
+  if (srcTokens.empty() || dstTokens.empty()) {
+    throw ClientError::badRequest(); // the root can't move
+  }
+
+  FileSystemLock guard(&lock);
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+  try {
+    map<string, int> directories;
+    int srcParent = resolveDirectory(srcTokens, srcTokens.size() - 1, false, &directories);
+    int dstParent = resolveDirectory(dstTokens, dstTokens.size() - 1, true, &directories);
+
+    int ret = fileSystem->rename(srcParent, srcTokens.back(), dstParent, dstTokens.back());
+    if (ret == -ENOTFOUND) {
+      throw ClientError::notFound();
+    } else if (ret == -ENOTENOUGHSPACE) {
+      throw ClientError::insufficientStorage();
+    } else if (ret == -EINVALIDTYPE || ret == -EDIRNOTEMPTY || ret == -EMOVEINTOSELF) {
+      throw ClientError::conflict();
+    } else if (ret < 0) {
+      throw ClientError::badRequest();
+    }
+    disk->commit();
+  } catch (const ClientError &e) {
+    disk->rollback();
+    throw;
+  } catch (...) {
+    disk->rollback();
+    throw ClientError::badRequest();
+  }
+
+  string srcKey = pathKey(path);
+  string dstKey = pathKey(destination);
+  versions.erase(srcKey);
+  versions.erase(dstKey);
+  changes->record(srcKey);
+  changes->record(dstKey);
+  if (leases != NULL) {
+    leases->revoke(srcKey, true);
+    leases->revoke(dstKey, true);
+  }
+  response->setStatus(200);
+}
+
+// COPY Method - copy a file to the path in the Destination header. The
+// copy shares the source's blocks until one of them is written.
+void DistributedFileSystemService::copy(HTTPRequest *request, HTTPResponse *response) {
+  string path = request->getPath().substr(5); // remove /ds3/
+  string destination = destinationPath(request);
+
+  if (replicas != NULL) {
+    // the copy would start without a version vector of its own
+    throw ClientError::badRequest();
+  }
+
+  vector<string> srcTokens = StringUtils::split(path, '/');
+  vector<string> dstTokens = StringUtils::split(destination, '/');
+  if (srcTokens.empty() || dstTokens.empty()) {
+    throw ClientError::badRequest();
+  }
+
+  FileSystemLock guard(&lock);
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+  try {
+    map<string, int> directories;
+    int srcParent = resolveDirectory(srcTokens, srcTokens.size() - 1, false, &directories);
+    int source = fileSystem->lookup(srcParent, srcTokens.back());
+    if (source < 0) {
+      throw ClientError::notFound();
+    }
+    int dstParent = resolveDirectory(dstTokens, dstTokens.size() - 1, true, &directories);
+
+    int ret = fileSystem->clone(source, dstParent, dstTokens.back());
+    if (ret == -ENOTENOUGHSPACE) {
+      throw ClientError::insufficientStorage();
+    } else if (ret == -EINVALIDTYPE) {
+      throw ClientError::conflict(); // directories don't copy, or dst is one
+    } else if (ret < 0) {
+      throw ClientError::badRequest();
+    }
+    disk->commit();
+  } catch (const ClientError &e) {
+    disk->rollback();
+    throw;
+  } catch (...) {
+    disk->rollback();
+    throw ClientError::badRequest();
+  }
+
+  string dstKey = pathKey(destination);
+  changes->record(dstKey);
+  if (leases != NULL) {
+    leases->revoke(dstKey);
+  }
+  response->setStatus(200);
+}
+
+// POST Method - apply a batch of PUTs and DELETEs in one transaction
+//
+// The body is a list of operations, paths are relative to the request path:
+//   PUT <path> <length>\n<length bytes of content>
+//   DELETE <path>\n
+// The response has a "<status> <path>" line per operation, in order. An
+// operation that fails is undone on its own and the rest still commit.
+void DistributedFileSystemService::post(HTTPRequest *request, HTTPResponse *response) {
+  string base = request->getPath().substr(5); // remove /ds3/
+  if (!base.empty() && base.back() != '/') {
+    throw ClientError::badRequest();
+  }
+  if (replicas != NULL) {
+    // batches carry no version vectors, so they would bypass the quorum
+    throw ClientError::badRequest();
+  }
+
+  vector<BatchOperation> operations = parseBatch(request->getBody());
+
+  FileSystemLock guard(&lock);
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+
+  // directories resolved once for the whole batch
+  map<string, int> directories;
+  for (size_t idx = 0; idx < operations.size(); idx++) {
+    BatchOperation &operation = operations[idx];
+    int savepoint = disk->savepoint();
+    try {
+      if (operation.isDelete) {
+	applyDelete(base + operation.path, &directories);
       } else {
-        inode_t temp;
-        fileSystem->stat(inode, &temp);
-        if (temp.type != UFS_DIRECTORY) {
-          disk->rollback(); // rollback if conflict
-          throw ClientError::conflict();
-        }
-        parent = inode;
+	applyPut(base + operation.path, operation.body, &directories);
+      }
+      operation.status = 200;
+    } catch (const ClientError &e) {
+      operation.status = e.status_code;
+    } catch (...) {
+      operation.status = 400;
+    }
+    if (operation.status != 200) {
+      disk->rollbackTo(savepoint);
+      directories.clear();
+    }
+  }
+  disk->commit();
+
+  stringstream result;
+  for (size_t idx = 0; idx < operations.size(); idx++) {
+    BatchOperation &operation = operations[idx];
+    if (operation.status == 200) {
+      string key = pathKey(base + operation.path);
+      if (operation.isDelete) {
+	versions.erase(key);
+      }
+      changes->record(key);
+      if (leases != NULL) {
+	leases->revoke(key);
       }
     }
+    result << operation.status << " " << operation.path << "\n";
+  }
+  response->setStatus(200);
+  response->setBody(result.str());
+}
 
-    // final component in path
-    string name = tokens.back();
-    int fileInode = fileSystem->lookup(parent, name);
+// the whole batch is rejected before anything is applied if it is malformed
+vector<DistributedFileSystemService::BatchOperation> DistributedFileSystemService::parseBatch(string body) {
+  vector<BatchOperation> operations;
+  size_t offset = 0;
+  while (offset < body.size()) {
+    size_t lineEnd = body.find('\n', offset);
+    if (lineEnd == string::npos) {
+      lineEnd = body.size();
+    }
+    string line = body.substr(offset, lineEnd - offset);
+    offset = lineEnd + 1;
+    if (line.empty()) {
+      continue;
+    }
 
-    if (fileInode < 0) {
-      // create a new file if it doesn't exist
-      if (isDirectory) {
-        fileInode = fileSystem->create(parent, UFS_DIRECTORY, name);
-      } else {
-        fileInode = fileSystem->create(parent, UFS_REGULAR_FILE, name);
+    BatchOperation operation;
+    operation.status = 0;
+    if (line.compare(0, 7, "DELETE ") == 0) {
+      operation.isDelete = true;
+      operation.path = line.substr(7);
+    } else if (line.compare(0, 4, "PUT ") == 0) {
+      // the length is the last word, paths may contain spaces
+      size_t space = line.find_last_of(' ');
+      if (space <= 3) {
+	throw ClientError::badRequest();
+      }
+      char *end;
+      unsigned long length = strtoul(line.c_str() + space + 1, &end, 10);
+      if (*end != '\0' || space + 1 == line.size() || length > body.size() - min(offset, body.size())) {
+	throw ClientError::badRequest();
+      }
+      operation.isDelete = false;
+      operation.path = line.substr(4, space - 4);
+      operation.body = body.substr(offset, length);
+      offset += length;
+      // an optional newline keeps batches readable
+      if (offset < body.size() && body[offset] == '\n') {
+	offset++;
       }
+    } else {
+      throw ClientError::badRequest();
     }
 
-    // check if it's a file and overwrite its contents
-    inode_t temp;
-    fileSystem->stat(fileInode, &temp);
+    if (pathKey(operation.path) == "") {
+      throw ClientError::badRequest();
+    }
+    operations.push_back(operation);
+    if (operations.size() > BATCH_MAX_OPERATIONS) {
+      throw ClientError::badRequest();
+    }
+  }
+  return operations;
+}
 
-    if (temp.type == UFS_REGULAR_FILE) {
-      // clear any existing content and write new data
-      fileSystem->write(fileInode, body.c_str(), body.size());
-    } else if (temp.type == UFS_DIRECTORY && !isDirectory) {
-      disk->rollback(); // conflict: trying to write to a directory
-      throw ClientError::conflict();
+// Walk the first `count` components of tokens from the root, creating
+// missing directories when create is set. Every directory found along the
+// way is remembered in directories, keyed by its pathKey.
+int DistributedFileSystemService::resolveDirectory(const vector<string> &tokens, size_t count, bool create,
+						   map<string, int> *directories) {
+  int parent = 0; // start at root directory
+  string key;
+  for (size_t i = 0; i < count; i++) {
+    key += (i > 0 ? "/" : "") + tokens[i];
+    map<string, int>::iterator cached = directories->find(key);
+    if (cached != directories->end()) {
+      parent = cached->second;
+      continue;
     }
 
-    // commit transaction if successful
-    disk->commit();
-    response->setStatus(200);
+    int inode = fileSystem->lookup(parent, tokens[i]);
+    if (inode < 0 && create) {
+      inode = fileSystem->create(parent, UFS_DIRECTORY, tokens[i]);
+      if (inode < 0) {
+	throw ClientError::insufficientStorage();
+      }
+    } else if (inode < 0) {
+      throw ClientError::notFound();
+    } else {
+      inode_t temp;
+      fileSystem->stat(inode, &temp);
+      if (temp.type != UFS_DIRECTORY) {
+	throw ClientError::conflict();
+      }
+    }
+    (*directories)[key] = inode;
+    parent = inode;
+  }
+  return parent;
+}
 
-  } catch (...) {
-    // rollback on any failure
-    fileSystem->disk->rollback();
+// the body of a PUT, inside a transaction the caller owns
+void DistributedFileSystemService::applyPut(string path, string body, map<string, int> *directories) {
+  vector<string> tokens = StringUtils::split(path, '/');
+  if (tokens.empty()) {
     throw ClientError::badRequest();
   }
+  bool isDirectory = path.back() == '/'; // check if the target is a directory
+
+  // traverse intermediate directories
+  int parent = resolveDirectory(tokens, tokens.size() - 1, true, directories);
+
+  // final component in path
+  string name = tokens.back();
+  int fileInode = fileSystem->lookup(parent, name);
+
+  if (fileInode < 0) {
+    // create a new file if it doesn't exist
+    fileInode = fileSystem->create(parent, isDirectory ? UFS_DIRECTORY : UFS_REGULAR_FILE, name);
+    if (fileInode < 0) {
+      throw ClientError::insufficientStorage();
+    }
+  }
+
+  // check if it's a file and overwrite its contents
+  inode_t temp;
+  fileSystem->stat(fileInode, &temp);
+
+  if (temp.type == UFS_REGULAR_FILE) {
+    // clear any existing content and write new data, even for a path
+    // with a trailing slash
+    if (fileSystem->write(fileInode, body.c_str(), body.size()) < 0) {
+      throw ClientError::insufficientStorage();
+    }
+  } else if (temp.type == UFS_DIRECTORY && !isDirectory) {
+    throw ClientError::conflict(); // conflict: trying to write to a directory
+  }
 }
 
+// the body of a DELETE, inside a transaction the caller owns
+void DistributedFileSystemService::applyDelete(string path, map<string, int> *directories) {
+  vector<string> tokens = StringUtils::split(path, '/');
+  if (tokens.empty()) {
+    throw ClientError::badRequest(); // the root can't be deleted
+  }
 
+  // lookup parent inode
+  int parentInode = resolveDirectory(tokens, tokens.size() - 1, false, directories);
 
-// DELETE Method - delete files or directories
-void DistributedFileSystemService::del(HTTPRequest *request, HTTPResponse *response) {
-  string path = request->getPath(); // get path from request
-  path = path.substr(5);            // remove "/ds3/"
+  // lookup target inode
+  string name = tokens.back();
+  int targetInode = fileSystem->lookup(parentInode, name);
+  if (targetInode < 0) {
+    throw ClientError::notFound(); // target not found
+  }
 
-  try {
-    // begin transaction
-    Disk *disk = fileSystem->disk;
-    disk->beginTransaction();
+  // check if directory is non-empty
+  inode_t targetInodeData;
+  fileSystem->stat(targetInode, &targetInodeData);
 
-    // handle trailing slash in paths
-    if (!path.empty() && path.back() == '/') {
-      path.pop_back(); // remove trailing slash
+  if (targetInodeData.type == UFS_DIRECTORY && 
+      targetInodeData.size > static_cast<int>(2 * sizeof(dir_ent_t))) {
+    throw ClientError::conflict(); // directory not empty
+  }
+
+  // perform Unlink
+  if (fileSystem->unlink(parentInode, name) < 0) {
+    throw ClientError::notFound(); // unlink failed
+  }
+  directories->erase(pathKey(path));
+}
+
+
+// Replicated GET: read our own copy, ask the other replicas in parallel and
+// answer with the newest copy once enough of them have replied. Replicas
+// that answered with an older copy are repaired in the background.
+void DistributedFileSystemService::coordinatedGet(string path, HTTPRequest *request, HTTPResponse *response) {
+  int needed = replicasNeeded(request) - 1; // our own copy counts as one
+  string key = pathKey(path);
+
+  bool haveLocal = true;
+  bool isDirectory = false;
+  string localBody;
+  VersionVector localVersion;
+  {
+    FileSystemLock guard(&lock);
+    try {
+      localBody = readPath(fileSystem, path, &isDirectory);
+      localVersion = versions[key];
+    } catch (const ClientError &e) {
+      haveLocal = false;
     }
+  }
+
+  // directory listings are not versioned, serve them locally
+  if (haveLocal && isDirectory) {
+    response->setBody(localBody);
+    return;
+  }
 
-    // split path into parent and name
-    size_t pos = path.find_last_of('/');
-    string parentPath = (pos == string::npos) ? "" : path.substr(0, pos);
-    string name = (pos == string::npos) ? path : path.substr(pos + 1);
+  // a single answer is enough, and we have one
+  if (needed == 0 && haveLocal) {
+    if (!localVersion.empty()) {
+      response->setHeader(VERSION_HEADER, localVersion.toString());
+    }
+    response->setBody(localBody);
+    return;
+  } else if (needed == 0) {
+    needed = 1;
+  }
 
-    // lookup parent inode
-    int parentInode = (parentPath.empty()) ? 0 : fileSystem->lookup(0, parentPath);
-    if (parentInode < 0) {
-      throw ClientError::notFound(); // parent directory not found
+  map<string, string> headers;
+  headers[REPLICA_HEADER] = replicaSecret;
+  vector<ReplicaResponse> answers = replicas->fanOut("GET", request->getPath(), "", headers, needed, false);
+  int answered = 0;
+  for (size_t idx = 0; idx < answers.size(); idx++) {
+    if (answers[idx].status < 500) {
+      answered++;
     }
+  }
+  if (answered < needed) {
+    throw ClientError::serviceUnavailable();
+  }
 
-    // lookup target inode
-    int targetInode = fileSystem->lookup(parentInode, name);
-    if (targetInode < 0) {
-      throw ClientError::notFound(); // target not found
+  // pick the newest copy, an empty newestPeer means our own copy
+  bool found = haveLocal;
+  string newestPeer;
+  string newestBody = localBody;
+  VersionVector newest = localVersion;
+  for (size_t idx = 0; idx < answers.size(); idx++) {
+    if (answers[idx].status != 200) {
+      continue;
+    }
+    VersionVector version = VersionVector::parse(answers[idx].version);
+    if (!found || version.newerThan(newest)) {
+      found = true;
+      newestPeer = answers[idx].peer;
+      newestBody = answers[idx].body;
+      newest = version;
     }
+  }
+
+  if (!found) {
+    throw ClientError::notFound();
+  }
 
-    // check if directory is non-empty
-    inode_t targetInodeData;
-    fileSystem->stat(targetInode, &targetInodeData);
+  // read repair, our own copy on a thread of its own like the peers'
+  if (newestPeer != "") {
+    struct LocalRepair *repair = new struct LocalRepair;
+    repair->service = this;
+    repair->path = path;
+    repair->body = newestBody;
+    repair->version = newest;
+    pthread_t thread;
+    dthread_create(&thread, NULL, repairLocal, repair);
+    dthread_detach(thread);
+  }
 
-    if (targetInodeData.type == UFS_DIRECTORY && 
-        targetInodeData.size > static_cast<int>(2 * sizeof(dir_ent_t))) {
-          throw ClientError::conflict(); // directory not empty
+  headers[VERSION_HEADER] = newest.toString();
+  for (size_t idx = 0; idx < answers.size(); idx++) {
+    if (answers[idx].peer == newestPeer) {
+      continue;
     }
+    if (answers[idx].status != 200 ||
+	VersionVector::parse(answers[idx].version).compare(newest) != VersionVector::EQUAL) {
+      replicas->sendAsync(answers[idx].peer, "PUT", request->getPath(), newestBody, headers);
+    }
+  }
 
+  response->setHeader(VERSION_HEADER, newest.toString());
+  response->setBody(newestBody);
+}
+
+// Replicated PUT: write locally with a new version, then send the write to
+// the other replicas in parallel and return once enough have acknowledged.
+void DistributedFileSystemService::coordinatedPut(string path, HTTPRequest *request, HTTPResponse *response) {
+  int needed = replicasNeeded(request) - 1; // our own write counts as one
+  string key = pathKey(path);
+
+  string body = request->getBody();
+  VersionVector version;
+  {
+    FileSystemLock guard(&lock);
+
+    // clients can pass along the version they read to carry its history
+    version = versions[key];
+    version.merge(VersionVector::parse(optionalHeader(request, VERSION_HEADER)));
+    version.increment(nodeId);
 
-    // perform Unlink
-    if (fileSystem->unlink(parentInode, name) < 0) {
-      throw ClientError::notFound(); // unlink failed
+    writePath(path, body);
+    versions[key] = version;
+  }
+
+  map<string, string> headers;
+  headers[REPLICA_HEADER] = replicaSecret;
+  headers[VERSION_HEADER] = version.toString();
+  vector<ReplicaResponse> acks = replicas->fanOut("PUT", request->getPath(), body, headers, needed, true);
+
+  int succeeded = 0;
+  for (size_t idx = 0; idx < acks.size(); idx++) {
+    if (acks[idx].status >= 200 && acks[idx].status < 300) {
+      succeeded++;
     }
+  }
+  // not enough replicas took the write, but the ones that did keep it
+  if (succeeded < needed) {
+    throw ClientError::serviceUnavailable();
+  }
 
-    // commit Transaction
-    disk->commit();
-    response->setStatus(200); // success
+  response->setHeader(VERSION_HEADER, version.toString());
+  response->setStatus(200);
+}
+
+// number of replicas, including this one, that must answer a request
+int DistributedFileSystemService::replicasNeeded(HTTPRequest *request) {
+  int total = replicas->peers().size() + 1;
+  string level = optionalHeader(request, CONSISTENCY_HEADER);
+
+  if (level == "one") {
+    return 1;
+  } else if (level == "all") {
+    return total;
+  } else if (level == "" || level == "quorum") {
+    return total / 2 + 1;
   }
-  catch (const ClientError &e) {
-    fileSystem->disk->rollback();
-    throw; // rethrow known errors
+  throw ClientError::badRequest();
+}
+
+// Only requests that know the shared secret skip the coordination, the
+// comparison takes as long whichever byte differs.
+bool DistributedFileSystemService::isReplicaRequest(HTTPRequest *request) {
+  string given = optionalHeader(request, REPLICA_HEADER);
+  if (replicaSecret.empty() || given.size() != replicaSecret.size()) {
+    return false;
   }
-  catch (const exception &e) {
-    fileSystem->disk->rollback();
-    throw ClientError::badRequest(); // catch unexpected errors
+  unsigned char differences = 0;
+  for (size_t idx = 0; idx < given.size(); idx++) {
+    differences |= given[idx] ^ replicaSecret[idx];
+  }
+  return differences == 0;
+}
+
+// Apply a read repair to our own copy, unless a write newer than the
+// repaired copy got there first.
+void *DistributedFileSystemService::repairLocal(void *arg) {
+  struct LocalRepair *repair = (struct LocalRepair *) arg;
+  DistributedFileSystemService *self = repair->service;
+  {
+    FileSystemLock guard(&self->lock);
+    VersionVector &local = self->versions[pathKey(repair->path)];
+    if (repair->version.newerThan(local)) {
+      try {
+	self->writePath(repair->path, repair->body);
+	local.merge(repair->version);
+      } catch (...) {
+	cerr << "read repair of " << repair->path << " failed" << endl;
+      }
+    }
+  }
+  delete repair;
+  return NULL;
+}
+
+// the path below /ds3/ that the Destination header of a MOVE or COPY
+// names, it may be a full URL
+string DistributedFileSystemService::destinationPath(HTTPRequest *request) {
+  string destination = optionalHeader(request, "Destination");
+  size_t scheme = destination.find("://");
+  if (scheme != string::npos) {
+    size_t slash = destination.find('/', scheme + 3);
+    destination = (slash == string::npos) ? "" : destination.substr(slash);
+  }
+  if (destination.compare(0, pathPrefix().size(), pathPrefix()) != 0) {
+    throw ClientError::badRequest();
+  }
+  return destination.substr(pathPrefix().size());
+}
+
+map<string, string> DistributedFileSystemService::queryParams(HTTPRequest *request) {
+  try {
+    return request->getParams();
+  } catch (const MalformedQueryString &e) {
+    throw ClientError::badRequest();
+  }
+}
+
+string DistributedFileSystemService::optionalHeader(HTTPRequest *request, string key) {
+  try {
+    return request->getHeader(key);
+  } catch (...) {
+    return "";
+  }
+}
+
+// versions and leases are tracked by path, without leading or trailing slashes
+string DistributedFileSystemService::pathKey(string path) {
+  vector<string> tokens = StringUtils::split(path, '/');
+  string key;
+  for (size_t idx = 0; idx < tokens.size(); idx++) {
+    if (idx > 0) {
+      key += "/";
+    }
+    key += tokens[idx];
   }
+  return key;
 }
@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <strings.h>
 
 #include "HttpUtils.h"
 #include "StringUtils.h"
@@ -53,7 +54,8 @@ string HTTPRequest::getHeader(string key) {
   vector<pair<string *, string *> > headers = m_http->getHeaders();
   for (iter = headers.begin(); iter != headers.end(); iter++) {
     string header_key = *(iter->first);
-    if (header_key == key) {
+    // header field names are case insensitive
+    if (strcasecmp(header_key.c_str(), key.c_str()) == 0) {
       return *(iter->second);
     }
   }
@@ -46,3 +46,8 @@ void HttpService::move(HTTPRequest *request, HTTPResponse *response) {
   throw ClientError::methodNotAllowed();
 }
 
+void HttpService::copy(HTTPRequest *request, HTTPResponse *response) {
+  cout << "COPY " << request->getPath() << endl;
+  throw ClientError::methodNotAllowed();
+}
+
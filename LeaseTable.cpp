@@ -0,0 +1,126 @@
+#include <time.h>
+
+#include <sstream>
+
+#include "LeaseTable.h"
+#include "dthread.h"
+
+using namespace std;
+
+LeaseTable::LeaseTable(int leaseMs) {
+  this->m_leaseMs = leaseMs;
+  pthread_mutex_init(&m_lock, NULL);
+  m_sequence = 0;
+  m_trimmed = 0;
+  m_nextSweep = 0;
+}
+
+long long LeaseTable::nowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+string LeaseTable::grant(string path) {
+  long long now = nowMs();
+
+  dthread_mutex_lock(&m_lock);
+  trim(now);
+  m_expiry[path] = now + m_leaseMs;
+  unsigned long sequence = m_sequence;
+  dthread_mutex_unlock(&m_lock);
+
+  // the client polls for revocations after `seq`, and times the lease
+  // from when it sent the request so clock skew does not matter
+  stringstream lease;
+  lease << "ttl=" << m_leaseMs << "; seq=" << sequence;
+  return lease.str();
+}
+
+void LeaseTable::revoke(string path, bool subtree) {
+  long long now = nowMs();
+
+  dthread_mutex_lock(&m_lock);
+  trim(now);
+  if (subtree) {
+    // leases are kept in path order, so the subtree is one range
+    string prefix = (path == "") ? "" : path + "/";
+    map<string, long long>::iterator lease = m_expiry.lower_bound(prefix);
+    if (lease != m_expiry.end() && lease->first == "") {
+      lease++; // the root is handled with the ancestors below
+    }
+    while (lease != m_expiry.end() && lease->first.compare(0, prefix.size(), prefix) == 0) {
+      if (lease->second > now) {
+	struct Revocation revocation;
+	revocation.sequence = ++m_sequence;
+	revocation.time = now;
+	revocation.path = lease->first;
+	m_log.push_back(revocation);
+      }
+      m_expiry.erase(lease++);
+    }
+  }
+  while (true) {
+    map<string, long long>::iterator lease = m_expiry.find(path);
+    if (lease != m_expiry.end()) {
+      // only leases that are still live need to be announced
+      if (lease->second > now) {
+	struct Revocation revocation;
+	revocation.sequence = ++m_sequence;
+	revocation.time = now;
+	revocation.path = path;
+	m_log.push_back(revocation);
+      }
+      m_expiry.erase(lease);
+    }
+
+    if (path == "") {
+      break;
+    }
+    size_t slash = path.find_last_of('/');
+    path = (slash == string::npos) ? "" : path.substr(0, slash);
+  }
+  dthread_mutex_unlock(&m_lock);
+}
+
+bool LeaseTable::revokedSince(unsigned long since, unsigned long *latest, vector<string> *paths) {
+  dthread_mutex_lock(&m_lock);
+  trim(nowMs());
+  *latest = m_sequence;
+  bool complete = (since >= m_trimmed);
+  if (complete) {
+    deque<struct Revocation>::iterator iter;
+    for (iter = m_log.begin(); iter != m_log.end(); iter++) {
+      if (iter->sequence > since) {
+	paths->push_back(iter->path);
+      }
+    }
+  }
+  dthread_mutex_unlock(&m_lock);
+
+  return complete;
+}
+
+// Revocations older than one lease period can be forgotten: every lease
+// they cancelled has expired by now anyway. Must hold m_lock.
+void LeaseTable::trim(long long now) {
+  while (m_log.size() > 0 && m_log.front().time + m_leaseMs < now) {
+    m_trimmed = m_log.front().sequence;
+    m_log.pop_front();
+  }
+
+  // sweeping expired leases once per lease period keeps the map bounded
+  if (now < m_nextSweep) {
+    return;
+  }
+  m_nextSweep = now + m_leaseMs;
+
+  map<string, long long>::iterator iter = m_expiry.begin();
+  while (iter != m_expiry.end()) {
+    if (iter->second <= now) {
+      m_expiry.erase(iter++);
+    } else {
+      iter++;
+    }
+  }
+}
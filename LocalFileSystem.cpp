@@ -1,10 +1,16 @@
 #include <iostream>
+#include <map>
 #include <string>
+#include <time.h>
 #include <vector>
+#include <algorithm>
 #include <assert.h>
+#include <climits>
 #include <cstring>
 
 #include "LocalFileSystem.h"
+#include "Lz4.h"
+#include "XxHash64.h"
 #include "ufs.h"
 
 using namespace std;
@@ -12,6 +18,39 @@ using namespace std;
 
 LocalFileSystem::LocalFileSystem(Disk *disk) {
   this->disk = disk;
+  compression = false;
+
+  super_t super;
+  readSuperBlock(&super);
+  if (super.checksum_addr != 0) {
+    disk->enableChecksums(super.checksum_addr, super.checksum_len);
+  }
+}
+
+void LocalFileSystem::setCompression(bool enabled) {
+  compression = enabled;
+}
+
+int LocalFileSystem::verifyChecksums(string region, bool enabled) {
+  super_t super;
+  readSuperBlock(&super);
+  if (super.checksum_addr == 0) {
+    return -ENOTSUPPORTED;
+  }
+
+  if (region == "super") {
+    disk->verifyChecksums(0, 1, enabled);
+  } else if (region == "bitmaps") {
+    disk->verifyChecksums(super.inode_bitmap_addr, super.inode_bitmap_len, enabled);
+    disk->verifyChecksums(super.data_bitmap_addr, super.data_bitmap_len, enabled);
+  } else if (region == "inodes") {
+    disk->verifyChecksums(super.inode_region_addr, super.inode_region_len, enabled);
+  } else if (region == "data") {
+    disk->verifyChecksums(super.data_region_addr, super.data_region_len, enabled);
+  } else {
+    return -EINVALIDNAME;
+  }
+  return 0;
 }
 
 void LocalFileSystem::readSuperBlock(super_t *super) {
@@ -25,92 +64,339 @@ void LocalFileSystem::readSuperBlock(super_t *super) {
   memcpy(super, buffer, sizeof(super_t));
 }
 
-void LocalFileSystem::readInodeBitmap(super_t *super, unsigned char *inodeBitmap) {
-  int startBlock = super->inode_bitmap_addr;
-  int numBlocks = super->inode_bitmap_len;
-
-  // allocate a buffer to read from disk
+void LocalFileSystem::writeSuperBlock(super_t *super) {
+  // the rest of the block stays as it is
   unsigned char buffer[UFS_BLOCK_SIZE];
+  disk->readBlock(0, buffer);
+  memcpy(buffer, super, sizeof(super_t));
+  disk->writeBlock(0, buffer);
+}
 
-  // read each block from disk into buffer, copy data to inode bitmap
-  for (int i = 0; i < numBlocks; i++) {
-    disk->readBlock(startBlock + i, buffer);     
-    memcpy(inodeBitmap + (i * UFS_BLOCK_SIZE), buffer, UFS_BLOCK_SIZE);
+// the blocks [start, start + count), for one Disk::readBlocks batch
+static vector<int> blockRange(int start, int count) {
+  vector<int> blockNumbers;
+  for (int i = 0; i < count; i++) {
+    blockNumbers.push_back(start + i);
   }
+  return blockNumbers;
+}
+
+void LocalFileSystem::readInodeBitmap(super_t *super, unsigned char *inodeBitmap) {
+  disk->readBlocks(blockRange(super->inode_bitmap_addr, super->inode_bitmap_len), inodeBitmap);
 }
 
 void LocalFileSystem::writeInodeBitmap(super_t *super, unsigned char *inodeBitmap) {
-  int startBlock = super->inode_bitmap_addr;
-  int numBlocks = super->inode_bitmap_len;
+  disk->writeBlocks(blockRange(super->inode_bitmap_addr, super->inode_bitmap_len), inodeBitmap);
+}
 
-  // allocate buffer to write to disk
-  unsigned char buffer[UFS_BLOCK_SIZE];
 
-  // copy each block from inode bitmap into buffer, write back to disk
-  for (int i = 0; i < numBlocks; i++) {
-    memcpy(buffer, inodeBitmap + (i * UFS_BLOCK_SIZE), UFS_BLOCK_SIZE);
-    disk->writeBlock(startBlock + i, buffer);     
+void LocalFileSystem::readDataBitmap(super_t *super, unsigned char *dataBitmap) {
+  disk->readBlocks(blockRange(super->data_bitmap_addr, super->data_bitmap_len), dataBitmap);
+}
+
+
+void LocalFileSystem::writeDataBitmap(super_t *super, unsigned char *dataBitmap) {
+  disk->writeBlocks(blockRange(super->data_bitmap_addr, super->data_bitmap_len), dataBitmap);
+}
+
+
+void LocalFileSystem::readInodeRegion(super_t *super, inode_t *inodes) {
+  // only the initialized blocks are read, the rest are zeroed inodes
+  int initialized = super->inode_region_len;
+  if (super->inode_init_len != 0) {
+    initialized = min(super->inode_init_len, super->inode_region_len);
   }
+  disk->readBlocks(blockRange(super->inode_region_addr, initialized), inodes);
+  memset(((unsigned char *) inodes) + initialized * UFS_BLOCK_SIZE, 0,
+	 (super->inode_region_len - initialized) * UFS_BLOCK_SIZE);
 }
 
 
-void LocalFileSystem::readDataBitmap(super_t *super, unsigned char *dataBitmap) {
-  int startBlock = super->data_bitmap_addr;
-  int numBlocks = super->data_bitmap_len;
+void LocalFileSystem::writeInodeRegion(super_t *super, inode_t *inodes) {
+  // unwritten blocks past the last one that holds an inode stay unwritten,
+  // the zeroed ones before it are written along with the rest
+  int numBlocks = super->inode_region_len;
+  if (super->inode_init_len != 0) {
+    unsigned char zeroes[UFS_BLOCK_SIZE];
+    memset(zeroes, 0, UFS_BLOCK_SIZE);
+    numBlocks = super->inode_init_len;
+    for (int i = numBlocks; i < super->inode_region_len; i++) {
+      if (memcmp(((unsigned char *) inodes) + i * UFS_BLOCK_SIZE, zeroes, UFS_BLOCK_SIZE) != 0) {
+	numBlocks = i + 1;
+      }
+    }
+  }
+
+  disk->writeBlocks(blockRange(super->inode_region_addr, numBlocks), inodes);
+  if (super->inode_init_len != 0 && numBlocks > super->inode_init_len) {
+    super->inode_init_len = numBlocks;
+    writeSuperBlock(super);
+  }
+}
 
-  // allocate buffer to read from disk
-  unsigned char buffer[UFS_BLOCK_SIZE];
 
-  // read each block from disk into buffer, copy data to data bitmap
-  for (int i = 0; i < numBlocks; i++) {
-    disk->readBlock(startBlock + i, buffer);
-    memcpy(dataBitmap + (i * UFS_BLOCK_SIZE), buffer, UFS_BLOCK_SIZE);
+// mkfs leaves the inode region past the first block unwritten
+bool LocalFileSystem::inodeBlockInitialized(super_t *super, int regionBlock) {
+  return super->inode_init_len == 0 || regionBlock < super->inode_init_len;
+}
+
+
+// Zero the unwritten blocks before regionBlock, which the caller is about
+// to write, so every block below the new mark holds real inodes.
+void LocalFileSystem::initializeInodeBlocks(super_t *super, int regionBlock) {
+  if (inodeBlockInitialized(super, regionBlock)) {
+    return;
+  }
+  unsigned char zeroes[UFS_BLOCK_SIZE];
+  memset(zeroes, 0, UFS_BLOCK_SIZE);
+  for (int i = super->inode_init_len; i < regionBlock; i++) {
+    disk->writeBlock(super->inode_region_addr + i, zeroes);
   }
+  super->inode_init_len = regionBlock + 1;
+  writeSuperBlock(super);
 }
 
 
-void LocalFileSystem::writeDataBitmap(super_t *super, unsigned char *dataBitmap) {
-  int startBlock = super->data_bitmap_addr;
-  int numBlocks = super->data_bitmap_len;
+void LocalFileSystem::readRefcounts(super_t *super, refcount_t *refcounts) {
+  disk->readBlocks(blockRange(super->refcount_addr, super->refcount_len), refcounts);
+}
+
+
+void LocalFileSystem::writeRefcounts(super_t *super, refcount_t *refcounts) {
+  disk->writeBlocks(blockRange(super->refcount_addr, super->refcount_len), refcounts);
+}
 
-  // allocate buffer to write to disk
-  unsigned char buffer[UFS_BLOCK_SIZE];
 
-  // copy each block from inode bitmap to buffer, write back to disk
-  for (int i = 0; i < numBlocks; i++) {
-    memcpy(buffer, dataBitmap + (i * UFS_BLOCK_SIZE), UFS_BLOCK_SIZE);
-    disk->writeBlock(startBlock + i, buffer);
+// only the block holding the inode is read, the region can be large
+void LocalFileSystem::readInode(super_t *super, int inodeNumber, inode_t *inode) {
+  int inodesPerBlock = UFS_BLOCK_SIZE / sizeof(inode_t);
+  inode_t buffer[inodesPerBlock];
+  if (!snapshotInodeBlocks.empty()) {
+    disk->readBlock(snapshotInodeBlocks[inodeNumber / inodesPerBlock], buffer);
+    *inode = buffer[inodeNumber % inodesPerBlock];
+    return;
   }
+  if (!inodeBlockInitialized(super, inodeNumber / inodesPerBlock)) {
+    memset(inode, 0, sizeof(inode_t));
+    return;
+  }
+  disk->readBlock(super->inode_region_addr + inodeNumber / inodesPerBlock, buffer);
+  *inode = buffer[inodeNumber % inodesPerBlock];
 }
 
 
-void LocalFileSystem::readInodeRegion(super_t *super, inode_t *inodes) {
-  int startBlock = super->inode_region_addr;
-  int numBlocks = super->inode_region_len;
+void LocalFileSystem::writeInode(super_t *super, int inodeNumber, inode_t *inode) {
+  int inodesPerBlock = UFS_BLOCK_SIZE / sizeof(inode_t);
+  inode_t buffer[inodesPerBlock];
+  int blockNumber = super->inode_region_addr + inodeNumber / inodesPerBlock;
+  if (!inodeBlockInitialized(super, inodeNumber / inodesPerBlock)) {
+    memset(buffer, 0, UFS_BLOCK_SIZE);
+    initializeInodeBlocks(super, inodeNumber / inodesPerBlock);
+  } else {
+    disk->readBlock(blockNumber, buffer);
+  }
+  buffer[inodeNumber % inodesPerBlock] = *inode;
+  disk->writeBlock(blockNumber, buffer);
+}
 
-  // allocate buffer to read from disk
-  unsigned char buffer[UFS_BLOCK_SIZE];
 
-  // read each block from disk into buffer, copy into inodes list
-  for (int i = 0; i < numBlocks; i++) {
-    disk->readBlock(startBlock + i, buffer);
-    memcpy(((unsigned char *) inodes) + (i * UFS_BLOCK_SIZE), buffer, UFS_BLOCK_SIZE);
+// the first free data block, marked used in dataBitmap, or -1 when full
+int LocalFileSystem::allocateDataBlock(super_t *super, unsigned char *dataBitmap) {
+  for (int dataIndex = 0; dataIndex < super->num_data; dataIndex++) {
+    if (!(dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8)))) {
+      dataBitmap[dataIndex / 8] |= (1 << (dataIndex % 8));
+      return dataIndex + super->data_region_addr;
+    }
   }
+  return -1;
 }
 
 
-void LocalFileSystem::writeInodeRegion(super_t *super, inode_t *inodes) {
-  int startBlock = super->inode_region_addr;
-  int numBlocks = super->inode_region_len;
+int LocalFileSystem::allocateDataBlocks(super_t *super, unsigned char *dataBitmap, int count, int goal,
+					vector<int> *blocks) {
+  int start = -1;
+  int goalIndex = goal - super->data_region_addr;
+  if (goalIndex >= 0 && goalIndex + count <= super->num_data) {
+    start = goalIndex;
+    for (int dataIndex = goalIndex; dataIndex < goalIndex + count && start >= 0; dataIndex++) {
+      if (dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8))) {
+	start = -1;
+      }
+    }
+  }
+  if (start < 0) {
+    start = freeRun(super, dataBitmap, count);
+  }
+
+  // no run is long enough, so the file is scattered over what is free
+  if (start < 0) {
+    while ((int) blocks->size() < count) {
+      int newDataBlock = allocateDataBlock(super, dataBitmap);
+      if (newDataBlock < 0) {
+	break;
+      }
+      blocks->push_back(newDataBlock);
+    }
+    return blocks->size();
+  }
+  for (int dataIndex = start; dataIndex < start + count; dataIndex++) {
+    dataBitmap[dataIndex / 8] |= (1 << (dataIndex % 8));
+    blocks->push_back(dataIndex + super->data_region_addr);
+  }
+  return count;
+}
+
+
+int LocalFileSystem::freeRun(super_t *super, unsigned char *dataBitmap, int count) {
+  int start = -1;
+  int run = 0;
+  for (int dataIndex = 0; dataIndex < super->num_data && run < count; dataIndex++) {
+    if (dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8))) {
+      run = 0;
+    } else if (run++ == 0) {
+      start = dataIndex;
+    }
+  }
+  return run < count ? -1 : start;
+}
 
-  // allocate buffer to write to disk
-  unsigned char buffer[UFS_BLOCK_SIZE];
 
-  // copy each block from inode list into  buffer, write back to disk
-  for (int i = 0; i < numBlocks; i++) {
-    memcpy(buffer, ((unsigned char *) inodes) + (i * UFS_BLOCK_SIZE), UFS_BLOCK_SIZE);
-    disk->writeBlock(startBlock + i, buffer);
+// drop one reference to a data block, the last one frees it in dataBitmap
+void LocalFileSystem::releaseDataBlock(super_t *super, unsigned char *dataBitmap, int blockNumber) {
+  if (references(super, blockNumber) > 0) {
+    setReferences(super, blockNumber, references(super, blockNumber) - 1);
+    return;
   }
+  forgetFingerprint(super, blockNumber);
+  int dataIndex = blockNumber - super->data_region_addr;
+  dataBitmap[dataIndex / 8] &= ~(1 << (dataIndex % 8));
+}
+
+
+// The allocated block that the fingerprint index says holds exactly these
+// bytes, or -1. The index is only a hint, so the block is read and compared.
+int LocalFileSystem::findDuplicate(super_t *super, unsigned char *dataBitmap, uint64_t hash,
+				   const unsigned char *contents) {
+  fingerprint_t slot = readFingerprint(super, hash);
+  if (slot.block == 0 || slot.hash != hash) {
+    return -1;
+  }
+  int dataIndex = slot.block - super->data_region_addr;
+  if (dataIndex < 0 || dataIndex >= super->num_data ||
+      !(dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8))) ||
+      references(super, slot.block) >= UFS_REFCOUNT_MAX) {
+    return -1;
+  }
+
+  unsigned char candidate[UFS_BLOCK_SIZE];
+  disk->readBlock(slot.block, candidate);
+  if (memcmp(candidate, contents, UFS_BLOCK_SIZE) != 0) {
+    return -1;
+  }
+  return slot.block;
+}
+
+
+fingerprint_t LocalFileSystem::readFingerprint(super_t *super, uint64_t hash) {
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(fingerprint_t);
+  int slot = hash % super->num_data;
+  fingerprint_t buffer[entriesPerBlock];
+  disk->readBlock(super->fingerprint_addr + slot / entriesPerBlock, buffer);
+  return buffer[slot % entriesPerBlock];
+}
+
+
+// the newest block with a hash wins its slot
+void LocalFileSystem::recordFingerprint(super_t *super, uint64_t hash, int blockNumber) {
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(fingerprint_t);
+  int slot = hash % super->num_data;
+  int fingerprintBlock = super->fingerprint_addr + slot / entriesPerBlock;
+  fingerprint_t buffer[entriesPerBlock];
+  disk->readBlock(fingerprintBlock, buffer);
+  if (buffer[slot % entriesPerBlock].hash == hash && (int) buffer[slot % entriesPerBlock].block == blockNumber) {
+    return;
+  }
+  buffer[slot % entriesPerBlock].hash = hash;
+  buffer[slot % entriesPerBlock].block = blockNumber;
+  disk->writeBlock(fingerprintBlock, buffer);
+}
+
+
+// A freed block may come back as metadata that is changed in place, so
+// the index must stop offering it.
+void LocalFileSystem::forgetFingerprint(super_t *super, int blockNumber) {
+  if (super->fingerprint_addr == 0) {
+    return;
+  }
+  unsigned char contents[UFS_BLOCK_SIZE];
+  disk->readBlock(blockNumber, contents);
+  uint64_t hash = XxHash64::hash(contents, UFS_BLOCK_SIZE);
+
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(fingerprint_t);
+  int slot = hash % super->num_data;
+  int fingerprintBlock = super->fingerprint_addr + slot / entriesPerBlock;
+  fingerprint_t buffer[entriesPerBlock];
+  disk->readBlock(fingerprintBlock, buffer);
+  if ((int) buffer[slot % entriesPerBlock].block == blockNumber) {
+    memset(&buffer[slot % entriesPerBlock], 0, sizeof(fingerprint_t));
+    disk->writeBlock(fingerprintBlock, buffer);
+  }
+}
+
+
+// Write block `index` of an inode. A block that is shared with a copy or a
+// snapshot is moved to a private block first, which changes inode->direct:
+// the caller writes the inode back. Pass the caller's dataBitmap when it
+// holds one in memory, NULL to update the one on disk.
+int LocalFileSystem::writeInodeBlock(super_t *super, inode_t *inode, int index, const void *buffer,
+				     unsigned char *dataBitmap) {
+  if (references(super, inode->direct[index]) > 0) {
+    vector<unsigned char> diskBitmap;
+    unsigned char *bitmap = dataBitmap;
+    if (bitmap == NULL) {
+      diskBitmap.resize(super->data_bitmap_len * UFS_BLOCK_SIZE);
+      bitmap = diskBitmap.data();
+      readDataBitmap(super, bitmap);
+    }
+
+    int newDataBlock = allocateDataBlock(super, bitmap);
+    if (newDataBlock < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    releaseDataBlock(super, bitmap, inode->direct[index]);
+    inode->direct[index] = newDataBlock;
+
+    if (dataBitmap == NULL) {
+      writeDataBitmap(super, bitmap);
+    }
+  }
+  disk->writeBlock(inode->direct[index], (void *) buffer);
+  return 0;
+}
+
+
+// how many inodes share a data block beyond the first, images without a
+// refcount region never share blocks
+int LocalFileSystem::references(super_t *super, int blockNumber) {
+  if (super->refcount_addr == 0) {
+    return 0;
+  }
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(refcount_t);
+  int dataIndex = blockNumber - super->data_region_addr;
+  refcount_t buffer[entriesPerBlock];
+  disk->readBlock(super->refcount_addr + dataIndex / entriesPerBlock, buffer);
+  return buffer[dataIndex % entriesPerBlock];
+}
+
+
+void LocalFileSystem::setReferences(super_t *super, int blockNumber, int references) {
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(refcount_t);
+  int dataIndex = blockNumber - super->data_region_addr;
+  int refcountBlock = super->refcount_addr + dataIndex / entriesPerBlock;
+  refcount_t buffer[entriesPerBlock];
+  disk->readBlock(refcountBlock, buffer);
+  buffer[dataIndex % entriesPerBlock] = references;
+  disk->writeBlock(refcountBlock, buffer);
 }
 
 
@@ -170,17 +456,58 @@ int LocalFileSystem::stat(int inodeNumber, inode_t *inode) {
         return -EINVALIDINODE;
     }
 
-    // read inode region into a table
-    inode_t *inodeTable = new inode_t[super.inode_region_len * UFS_BLOCK_SIZE];
-    readInodeRegion(&super, inodeTable);
+    readInode(&super, inodeNumber, inode);
+    inode->type &= UFS_TYPE_MASK;
+    return 0; 
+}
 
-    // access requested inode and copy it over to pointer
-    *inode = inodeTable[inodeNumber];
 
-    // free dynamically allocated memory
-    delete[] inodeTable; 
+int LocalFileSystem::storedBlocks(int inodeNumber) {
+  super_t super;
+  readSuperBlock(&super);
+  if (inodeNumber < 0 || inodeNumber >= super.num_inodes) {
+    return -EINVALIDINODE;
+  }
+  inode_t inode;
+  readInode(&super, inodeNumber, &inode);
+  return blocksOf(&inode);
+}
 
-    return 0; 
+
+int LocalFileSystem::blocksOf(const inode_t *inode) {
+  if (inode->type & UFS_FLAG_INLINE) {
+    return 0;
+  }
+  int bytes = inode->size;
+  if (inode->type & UFS_FLAG_COMPRESSED) {
+    bytes = inode->direct[DIRECT_PTRS - 1];
+  }
+  return (bytes + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+}
+
+
+// Bytes compressed data takes, or size when storing it as it is wins. A
+// sample from the start decides whether compressing everything is worth
+// it, since media and archives don't shrink.
+int LocalFileSystem::compressedSize(const void *buffer, int size, vector<unsigned char> *compressed) {
+  int blocks = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+  if (!compression || blocks < 2) {
+    return size;
+  }
+
+  const unsigned char *bytes = (const unsigned char *) buffer;
+  int sampleSize = min(size, UFS_BLOCK_SIZE);
+  compressed->resize(sampleSize);
+  int sampled = Lz4::compress(bytes, sampleSize, compressed->data(), sampleSize * 7 / 8);
+  if (sampled < 0) {
+    return size;
+  }
+
+  // only worth it when a whole block is saved
+  int capacity = (blocks - 1) * UFS_BLOCK_SIZE;
+  compressed->resize(capacity);
+  int length = Lz4::compress(bytes, size, compressed->data(), capacity);
+  return length < 0 ? size : length;
 }
 
 
@@ -198,37 +525,52 @@ int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
 
     // read inode metadata
     inode_t inode;
-    stat(inodeNumber, &inode);
+    readInode(&super, inodeNumber, &inode);
 
     // validate inode size
     if (size < 0 || size > inode.size) {
       return -EINVALIDSIZE;
     }
 
-    // read out block data
-    int bytesRead = 0;
-    for (int i = 0; i < DIRECT_PTRS && bytesRead < size; i++) {
+    // small files need nothing beyond the inode
+    if (inode.type & UFS_FLAG_INLINE) {
+      memcpy(buffer, inode.direct, size);
+      return size;
+    }
 
-      // read each block into intermediate buffer
-      unsigned char intermed_buffer[UFS_BLOCK_SIZE];
-      disk->readBlock(inode.direct[i], intermed_buffer);
-      
-      // calculate how much data to copy, if the current amount of bytes is less than the block size
-      // only copy over that many bytes, else copy over the block size (4096)
-      int bytesToCopy = (size - bytesRead < UFS_BLOCK_SIZE) ? (size - bytesRead) : UFS_BLOCK_SIZE;
+    if (inode.type & UFS_FLAG_COMPRESSED) {
+      int storedSize = inode.direct[DIRECT_PTRS - 1];
+      vector<unsigned char> stored(blocksOf(&inode) * UFS_BLOCK_SIZE);
+      disk->readBlocks(vector<int>(inode.direct, inode.direct + blocksOf(&inode)), stored.data());
+      vector<unsigned char> contents(inode.size);
+      if (Lz4::decompress(stored.data(), storedSize, contents.data(), inode.size) < 0) {
+	cerr << "Error reading file" << endl;
+	return -EINVALIDSIZE;
+      }
+      memcpy(buffer, contents.data(), size);
+      return size;
+    }
 
-      // copy data into buffer
-      memcpy((unsigned char *)buffer + bytesRead, intermed_buffer, bytesToCopy);
-      bytesRead += bytesToCopy;
+    // read out block data, all the blocks the size covers in one batch
+    int blocks = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    vector<unsigned char> contents(blocks * UFS_BLOCK_SIZE);
+    disk->readBlocks(vector<int>(inode.direct, inode.direct + blocks), contents.data());
+    if (size > 0) {
+      memcpy(buffer, contents.data(), size);
     }
-    
+
     // return number of bytes read
-    return bytesRead; 
+    return size;
 }
 
 
 
 int LocalFileSystem::create(int parentInodeNumber, int type, string name) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
   // load super block
   super_t super;
   readSuperBlock(&super);
@@ -259,13 +601,16 @@ int LocalFileSystem::create(int parentInodeNumber, int type, string name) {
     }
   }
 
+  // the flags of the parent have to survive writing it back
+  readInode(&super, parentInodeNumber, &parentInode);
+
   // read through inode bitmap, check for free space
-  unsigned char inodeBitmap[super.inode_bitmap_len * UFS_BLOCK_SIZE];
-  readInodeBitmap(&super, inodeBitmap);
+  vector<unsigned char> inodeBitmap(super.inode_bitmap_len * UFS_BLOCK_SIZE);
+  readInodeBitmap(&super, inodeBitmap.data());
 
   // read through data bitmap, see if there is space (directories)
-  unsigned char dataBitmap[super.data_bitmap_len * UFS_BLOCK_SIZE];
-  readDataBitmap(&super, dataBitmap);
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
   
 
   // initialize variable to store new inode number
@@ -298,7 +643,8 @@ int LocalFileSystem::create(int parentInodeNumber, int type, string name) {
   int newBlockNum = -1;
 
   // check if parent directory has space in existing blocks
-  if (currentEntries % entriesPerBlock == 0) { // need to allocate a new block
+  bool parentInline = parentInode.type & UFS_FLAG_INLINE;
+  if (!parentInline && currentEntries % entriesPerBlock == 0) { // need to allocate a new block
     // find free block in data bitmap
     for (int blockIndex = 0; blockIndex < super.num_data; blockIndex++) {
         int byteIndex = blockIndex / 8;
@@ -333,48 +679,40 @@ int LocalFileSystem::create(int parentInodeNumber, int type, string name) {
   newInode.type = type;
   newInode.size = 0; // default inode size
 
-  // if inode is a directory, allocate a data block for entries "." and ".."
-  int dirBlockNum = -1;
+  // new files and directories start out inline, without data blocks
+  memset(newInode.direct, 0, sizeof(newInode.direct));
+  newInode.type |= UFS_FLAG_INLINE;
   if (type == UFS_DIRECTORY) {
-      for (int blockIndex = 0; blockIndex < super.num_data; blockIndex++) {
-          int byteIndex = blockIndex / 8;
-          int bitIndex = blockIndex % 8;
-          if (!(dataBitmap[byteIndex] & (1 << bitIndex))) {
-              dirBlockNum = blockIndex;
-              newInode.direct[0] = dirBlockNum + super.data_region_addr;
-              dataBitmap[dirBlockNum / 8] |= (1 << (dirBlockNum % 8));
-              break;
-          }
-      }
-      if (dirBlockNum == -1) {
-          return -ENOTENOUGHSPACE; // no space for new directory block
-      }
-
-
       // fil out new directory metadata
       newInode.size = 2 * sizeof(dir_ent_t); // "." and ".."
 
-      // copy over both entries to its new datablock
+      // copy over both entries into the inode
       dir_ent_t dirEntries[2] = {};
       strncpy(dirEntries[0].name, ".", DIR_ENT_NAME_SIZE);
       dirEntries[0].inum = newInodeNum;
 
       strncpy(dirEntries[1].name, "..", DIR_ENT_NAME_SIZE);
       dirEntries[1].inum = parentInodeNumber;
-
-      // fill in buffer and write this block to disk
-      unsigned char dirBlock[UFS_BLOCK_SIZE];
-      memcpy(dirBlock, dirEntries, sizeof(dirEntries));
-      disk->writeBlock(newInode.direct[0] , dirBlock);
-
+      memcpy(newInode.direct, dirEntries, sizeof(dirEntries));
   }
 
 
   // update parent directory with new entry
-  dir_ent_t newEntry;
+  dir_ent_t newEntry = {};
   strncpy(newEntry.name, name.c_str(), DIR_ENT_NAME_SIZE);
   newEntry.inum = newInodeNum;
 
+  if (parentInline) {
+    if (addInlineEntry(&super, &parentInode, &newEntry, dataBitmap.data()) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    writeInode(&super, newInodeNum, &newInode);
+    writeInode(&super, parentInodeNumber, &parentInode);
+    writeInodeBitmap(&super, inodeBitmap.data());
+    writeDataBitmap(&super, dataBitmap.data());
+    return newInodeNum;
+  }
+
   // write new entry to parent directory
   unsigned char buffer[parentInode.size];
   int bytesRead = read(parentInodeNumber, buffer, parentInode.size);
@@ -399,26 +737,29 @@ int LocalFileSystem::create(int parentInodeNumber, int type, string name) {
     int bytesToWrite = min(UFS_BLOCK_SIZE, parentInode.size - startOffset);
     memcpy(tempBuffer, write_buffer + startOffset, bytesToWrite);
 
-    disk->writeBlock(parentInode.direct[i], tempBuffer);
+    if (writeInodeBlock(&super, &parentInode, i, tempBuffer, dataBitmap.data()) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
   }
   
   // write new inode, updated parent inode meta data back to disk
-  inode_t *inodeRegion = new inode_t[super.inode_region_len * UFS_BLOCK_SIZE];
-  readInodeRegion(&super, inodeRegion);
-  inodeRegion[newInodeNum] = newInode;
-  inodeRegion[parentInodeNumber] = parentInode;
-  writeInodeRegion(&super, inodeRegion);
-  delete[] inodeRegion;
+  writeInode(&super, newInodeNum, &newInode);
+  writeInode(&super, parentInodeNumber, &parentInode);
 
   // after all updates, writeback to both bitmaps to preserve state
-  writeInodeBitmap(&super, inodeBitmap);
-  writeDataBitmap(&super, dataBitmap);
+  writeInodeBitmap(&super, inodeBitmap.data());
+  writeDataBitmap(&super, dataBitmap.data());
 
   return newInodeNum; // return inode number of new entry
 }
 
 
 int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
   // load super block
   super_t super;
   readSuperBlock(&super);
@@ -439,80 +780,180 @@ int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
     return -EINVALIDSIZE;
   }
 
-  // blocks in inode.size
-  int curr_inode_blocks = inode.size / UFS_BLOCK_SIZE;
-  if ((inode.size % UFS_BLOCK_SIZE) != 0) {
-    curr_inode_blocks += 1;
+  // blocks the inode holds now, it may have been stored compressed
+  readInode(&super, inodeNumber, &inode);
+  int curr_inode_blocks = blocksOf(&inode);
+
+  // small enough to live in the inode, whatever blocks it had go back
+  if (size <= (int) UFS_INLINE_SIZE) {
+    if (curr_inode_blocks > 0) {
+      vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+      readDataBitmap(&super, dataBitmap.data());
+      for (int i = 0; i < curr_inode_blocks; i++) {
+	releaseDataBlock(&super, dataBitmap.data(), inode.direct[i]);
+      }
+      writeDataBitmap(&super, dataBitmap.data());
+    }
+    inode.type = UFS_REGULAR_FILE | UFS_FLAG_INLINE;
+    inode.size = size;
+    memset(inode.direct, 0, sizeof(inode.direct));
+    if (size > 0) {
+      memcpy(inode.direct, buffer, size);
+    }
+    writeInode(&super, inodeNumber, &inode);
+    return size;
   }
 
+  // what goes into the blocks, the caller's bytes or their compressed form
+  int logicalSize = size;
+  vector<unsigned char> compressed;
+  int storedSize = compressedSize(buffer, size, &compressed);
+
   // blocks needed for write
-  int blocks_to_write = size / UFS_BLOCK_SIZE;
-  if ((size % UFS_BLOCK_SIZE) != 0) {
-    blocks_to_write += 1;
-  }
+  int blocks_to_write = (storedSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
 
   // read through data bitmap, see if there is space
-  unsigned char dataBitmap[super.data_bitmap_len * UFS_BLOCK_SIZE];
-  readDataBitmap(&super, dataBitmap);
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+
+  // a compressed file can't be cut short like a plain one, so store it
+  // plainly and let that fill what space there is
+  if (storedSize < size) {
+    int freeBlocks = 0;
+    for (int dataIndex = 0; dataIndex < super.num_data; dataIndex++) {
+      freeBlocks += !(dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8)));
+    }
+    int sharedBlocks = 0;
+    for (int i = 0; i < min(curr_inode_blocks, blocks_to_write); i++) {
+      sharedBlocks += references(&super, inode.direct[i]) > 0;
+    }
+    if (blocks_to_write - curr_inode_blocks + sharedBlocks > freeBlocks) {
+      storedSize = size;
+      blocks_to_write = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    }
+  }
+  bool isCompressed = storedSize < size;
+  if (isCompressed) {
+    buffer = compressed.data();
+    size = storedSize;
+  }
+
+  // The whole file is at hand, so its new blocks are allocated together
+  // and land in one run when the free space allows.
+
+  // blocks that another inode shares get a private copy before we write
+  // them. Find the replacements first so that a full disk changes nothing.
+  vector<int> shared;
+  for (int i = 0; i < min(curr_inode_blocks, blocks_to_write); i++) {
+    if (references(&super, inode.direct[i]) > 0) {
+      shared.push_back(i);
+    }
+  }
+  vector<int> replacements;
+  if (allocateDataBlocks(&super, dataBitmap.data(), shared.size(), -1, &replacements) < (int) shared.size()) {
+    return -ENOTENOUGHSPACE;
+  }
+  vector<int> unshared;
+  for (size_t i = 0; i < shared.size(); i++) {
+    unshared.push_back(inode.direct[shared[i]]);
+    inode.direct[shared[i]] = replacements[i];
+  }
+  for (size_t i = 0; i < unshared.size(); i++) {
+    releaseDataBlock(&super, dataBitmap.data(), unshared[i]);
+  }
 
   // free data blocks that are no longer needed
   if(blocks_to_write < curr_inode_blocks){
-    for(int i = 0; i < curr_inode_blocks; i++){
-      if(i < blocks_to_write){
-        continue;
-      }
-      int current_block = inode.direct[i] - super.data_region_addr;
-      dataBitmap[current_block / 8] &= ~(1 << (current_block % 8));
+    for(int i = blocks_to_write; i < curr_inode_blocks; i++){
+      releaseDataBlock(&super, dataBitmap.data(), inode.direct[i]);
     }
-    writeDataBitmap(&super, dataBitmap);
   }
 
-  // check if can add blocks to our inode
+  // check if can add blocks to our inode, preferably right after its last
   if (blocks_to_write > curr_inode_blocks) {
-    for (int i = curr_inode_blocks; i < blocks_to_write; i++) {
-      int newDataBlock = -1;
-      for (int dataIndex = 0; dataIndex < super.num_data; dataIndex++) {
-          int byteIndex = dataIndex / 8;
-          int bitIndex = dataIndex % 8; 
-
-          // check if the dataIndex is free in databitmap
-          if (!(dataBitmap[byteIndex] & (1 << bitIndex))) { 
-              // free datablock found
-              newDataBlock = dataIndex; 
-              // update databitmap
-              dataBitmap[newDataBlock / 8] |= (1 << (newDataBlock % 8));
-              inode.direct[i] = newDataBlock + super.data_region_addr;
-              break;
-          }
-      }
-      // breakout and relabel copy size
-      if (newDataBlock == -1) {
-        size = i * UFS_BLOCK_SIZE;
-        blocks_to_write = i;
-        break;
-      }
+    int goal = curr_inode_blocks > 0 ? (int) inode.direct[curr_inode_blocks - 1] + 1 : -1;
+    vector<int> added;
+    int found = allocateDataBlocks(&super, dataBitmap.data(), blocks_to_write - curr_inode_blocks, goal, &added);
+    for (int i = 0; i < found; i++) {
+      inode.direct[curr_inode_blocks + i] = added[i];
+    }
+    // breakout and relabel copy size
+    if (curr_inode_blocks + found < blocks_to_write) {
+      blocks_to_write = curr_inode_blocks + found;
+      size = blocks_to_write * UFS_BLOCK_SIZE;
     }
-    // write back data bitmap 
-    writeDataBitmap(&super, dataBitmap);
   }
-  
-  // update our inode size
-  inode.size = size;
 
-  // rewrite all necessary data, update inodes direct pointers
+  // update our inode size
+  inode.size = isCompressed ? logicalSize : size;
+  inode.type = UFS_REGULAR_FILE | (isCompressed ? UFS_FLAG_COMPRESSED : 0);
+
+  // rewrite all necessary data, update inodes direct pointers. Blocks
+  // nobody shares go out together at the end, in as few runs as their
+  // addresses allow.
+  bool dedup = super.fingerprint_addr != 0;
+  bool bitmapChanged = unshared.size() > 0 || blocks_to_write != curr_inode_blocks;
+  vector<int> pendingBlocks;
+  vector<unsigned char> pendingContents;
   for (int i = 0; i < blocks_to_write; i++) {
     // buffer to write back
-    unsigned char write_buffer[UFS_BLOCK_SIZE];
-    memcpy(write_buffer, (const unsigned char*)buffer + (i * UFS_BLOCK_SIZE), UFS_BLOCK_SIZE);
-    disk->writeBlock(inode.direct[i], write_buffer);
+    // the last block may be partial, only copy what the caller gave us
+    unsigned char write_buffer[UFS_BLOCK_SIZE] = {0};
+    int bytesToCopy = min(UFS_BLOCK_SIZE, size - (i * UFS_BLOCK_SIZE));
+    memcpy(write_buffer, (const unsigned char*)buffer + (i * UFS_BLOCK_SIZE), bytesToCopy);
+
+    // point at a block that already holds these bytes instead of writing them
+    uint64_t hash = 0;
+    if (dedup) {
+      hash = XxHash64::hash(write_buffer, UFS_BLOCK_SIZE);
+      // a candidate still holding its old contents on disk must not match
+      int candidate = readFingerprint(&super, hash).block;
+      if (find(pendingBlocks.begin(), pendingBlocks.end(), candidate) != pendingBlocks.end()) {
+	disk->writeBlocks(pendingBlocks, pendingContents.data());
+	pendingBlocks.clear();
+	pendingContents.clear();
+      }
+      int duplicate = findDuplicate(&super, dataBitmap.data(), hash, write_buffer);
+      if (duplicate == (int) inode.direct[i]) {
+	continue;
+      } else if (duplicate >= 0) {
+	setReferences(&super, duplicate, references(&super, duplicate) + 1);
+	releaseDataBlock(&super, dataBitmap.data(), inode.direct[i]);
+	inode.direct[i] = duplicate;
+	bitmapChanged = true;
+	continue;
+      }
+    }
+
+    // earlier blocks of this write may have started sharing this one
+    unsigned int before = inode.direct[i];
+    if (references(&super, inode.direct[i]) == 0) {
+      pendingBlocks.push_back(inode.direct[i]);
+      pendingContents.insert(pendingContents.end(), write_buffer, write_buffer + UFS_BLOCK_SIZE);
+    } else if (writeInodeBlock(&super, &inode, i, write_buffer, dataBitmap.data()) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    bitmapChanged = bitmapChanged || inode.direct[i] != before;
+
+    if (dedup) {
+      recordFingerprint(&super, hash, inode.direct[i]);
+    }
+  }
+
+  disk->writeBlocks(pendingBlocks, pendingContents.data());
+
+  // write back data bitmap 
+  if (bitmapChanged) {
+    writeDataBitmap(&super, dataBitmap.data());
+  }
+
+  // the last pointer is never a block of a compressed file
+  if (isCompressed) {
+    inode.direct[DIRECT_PTRS - 1] = storedSize;
   }
 
   // writeback inode to inode region
-  inode_t *inodeRegion = new inode_t[super.inode_region_len * UFS_BLOCK_SIZE];
-  readInodeRegion(&super, inodeRegion);
-  inodeRegion[inodeNumber] = inode;
-  writeInodeRegion(&super, inodeRegion);
-  delete[] inodeRegion;
+  writeInode(&super, inodeNumber, &inode);
 
   return inode.size;
 }
@@ -521,6 +962,11 @@ int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
 
 
 int LocalFileSystem::unlink(int parentInodeNumber, string name) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
   // load in superblock
   super_t super;
   readSuperBlock(&super);
@@ -553,18 +999,19 @@ int LocalFileSystem::unlink(int parentInodeNumber, string name) {
   
   // find entry, delete its contents from file system
   inode_t inode_to_del;
-  stat(entry_to_delete, &inode_to_del);
+  readInode(&super, entry_to_delete, &inode_to_del);
+  readInode(&super, parentInodeNumber, &parentInode);
   
 
   // check for size of directory
   int empty_dir_size = 2 * sizeof(dir_ent_t);
-  if (inode_to_del.type == UFS_DIRECTORY && (inode_to_del.size > empty_dir_size)) {
+  if ((inode_to_del.type & UFS_TYPE_MASK) == UFS_DIRECTORY && (inode_to_del.size > empty_dir_size)) {
     return -EDIRNOTEMPTY;
   }
 
   // clear corresponding bit from inode bitmap
-  unsigned char inodeBitmap[super.inode_bitmap_len * UFS_BLOCK_SIZE];
-  readInodeBitmap(&super, inodeBitmap);
+  vector<unsigned char> inodeBitmap(super.inode_bitmap_len * UFS_BLOCK_SIZE);
+  readInodeBitmap(&super, inodeBitmap.data());
   inodeBitmap[entry_to_delete / 8] &= ~(1 << (entry_to_delete % 8));
 
   // original blocks to write
@@ -600,6 +1047,15 @@ int LocalFileSystem::unlink(int parentInodeNumber, string name) {
     num_blocks += 1;
   }
 
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+
+  // an inline parent only changes in its inode
+  if (parentInode.type & UFS_FLAG_INLINE) {
+    memcpy(parentInode.direct, buffer, parentInode.size);
+    num_blocks = origBlockCount = 0;
+  }
+
   for (int i = 0; i < num_blocks; i++) {
     unsigned char tempBuffer[UFS_BLOCK_SIZE];
     int startOffset = i * UFS_BLOCK_SIZE;
@@ -607,43 +1063,875 @@ int LocalFileSystem::unlink(int parentInodeNumber, string name) {
 
     memcpy(tempBuffer, buffer + startOffset, bytesToWrite);
 
-    disk->writeBlock(parentInode.direct[i], tempBuffer);
+    if (writeInodeBlock(&super, &parentInode, i, tempBuffer, dataBitmap.data()) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
   }
 
 
   // delete data blocks allocated
-  unsigned char dataBitmap[super.data_bitmap_len * UFS_BLOCK_SIZE];
-  readDataBitmap(&super, dataBitmap);
 
   // remove extra allocated data block for parent
   if (num_blocks < origBlockCount) {
-      int blockNumber = parentInode.direct[num_blocks] - super.data_region_addr;
-      dataBitmap[blockNumber / 8] &= ~(1 << (blockNumber % 8));
+      releaseDataBlock(&super, dataBitmap.data(), parentInode.direct[num_blocks]);
   }
 
   
   // free all data blocks originally allocated
-  int blocks = inode_to_del.size / UFS_BLOCK_SIZE;
-  if ((inode_to_del.size % UFS_BLOCK_SIZE) != 0) {
-    blocks += 1;
-  }    
+  int blocks = blocksOf(&inode_to_del);
   for (int i = 0; i < blocks; i++) {
-      int blockNumber = inode_to_del.direct[i] - super.data_region_addr;
-      dataBitmap[blockNumber / 8] &= ~(1 << (blockNumber % 8));
+      releaseDataBlock(&super, dataBitmap.data(), inode_to_del.direct[i]);
   }
 
-  writeDataBitmap(&super, dataBitmap);
-  writeInodeBitmap(&super, inodeBitmap);
+  writeDataBitmap(&super, dataBitmap.data());
+  writeInodeBitmap(&super, inodeBitmap.data());
 
   inode_to_del.type = 0;
   inode_to_del.size = 0;
   // write updated parent inode meta data to inodeRegion
-  inode_t *inodeRegion = new inode_t[super.inode_region_len * UFS_BLOCK_SIZE];
-  readInodeRegion(&super, inodeRegion);
-  inodeRegion[entry_to_delete] = inode_to_del;
-  inodeRegion[parentInodeNumber] = parentInode;
-  writeInodeRegion(&super, inodeRegion);
-  delete[] inodeRegion;
+  writeInode(&super, entry_to_delete, &inode_to_del);
+  writeInode(&super, parentInodeNumber, &parentInode);
 
   return 0;
 }
+
+
+int LocalFileSystem::rename(int srcParentInodeNumber, string srcName,
+			    int dstParentInodeNumber, string dstName) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  // load in superblock
+  super_t super;
+  readSuperBlock(&super);
+
+  // validate both parents, they must be directories
+  inode_t srcParent, dstParent;
+  if (stat(srcParentInodeNumber, &srcParent) != 0 || srcParent.type != UFS_DIRECTORY ||
+      stat(dstParentInodeNumber, &dstParent) != 0 || dstParent.type != UFS_DIRECTORY) {
+    return -EINVALIDINODE;
+  }
+
+  // check for invalid names
+  if (srcName.size() > DIR_ENT_NAME_SIZE || dstName.size() > DIR_ENT_NAME_SIZE ||
+      dstName.empty()) {
+    return -EINVALIDNAME;
+  }
+  if (srcName == "." || srcName == ".." || dstName == "." || dstName == "..") {
+    return -EUNLINKNOTALLOWED;
+  }
+
+  int source = lookup(srcParentInodeNumber, srcName);
+  if (source < 0) {
+    return -ENOTFOUND;
+  }
+  inode_t sourceInode;
+  stat(source, &sourceInode);
+  int sourceType = sourceInode.type;
+
+  // a directory can't move below itself, walk up from the destination
+  if (sourceType == UFS_DIRECTORY) {
+    int ancestor = dstParentInodeNumber;
+    while (true) {
+      if (ancestor == source) {
+	return -EMOVEINTOSELF;
+      }
+      if (ancestor == UFS_ROOT_DIRECTORY_INODE_NUMBER) {
+	break;
+      }
+      ancestor = lookup(ancestor, "..");
+      if (ancestor < 0) {
+	return -EINVALIDINODE;
+      }
+    }
+  }
+
+  // an existing destination is replaced, like rename(2)
+  int existing = lookup(dstParentInodeNumber, dstName);
+  if (existing == source) {
+    return 0;
+  }
+  if (existing >= 0) {
+    inode_t existingInode;
+    stat(existing, &existingInode);
+    if (existingInode.type != sourceType) {
+      return -EINVALIDTYPE;
+    }
+    int ret = unlink(dstParentInodeNumber, dstName);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  int ret = addEntry(&super, dstParentInodeNumber, dstName, source);
+  if (ret < 0) {
+    return ret;
+  }
+  removeEntry(&super, srcParentInodeNumber, srcName);
+
+  // a directory that changed parents has to point its ".." at the new one
+  if (sourceType == UFS_DIRECTORY && srcParentInodeNumber != dstParentInodeNumber) {
+    readInode(&super, source, &sourceInode);
+    if (sourceInode.type & UFS_FLAG_INLINE) {
+      ((dir_ent_t *) sourceInode.direct)[1].inum = dstParentInodeNumber;
+      writeInode(&super, source, &sourceInode);
+      return 0;
+    }
+    dir_ent_t entries[UFS_BLOCK_SIZE / sizeof(dir_ent_t)];
+    disk->readBlock(sourceInode.direct[0], entries);
+    entries[1].inum = dstParentInodeNumber;
+    if (writeInodeBlock(&super, &sourceInode, 0, entries, NULL) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    writeInode(&super, source, &sourceInode);
+  }
+
+  return 0;
+}
+
+
+// append an entry to a directory, growing it by a block when the last one is full
+int LocalFileSystem::addEntry(super_t *super, int parentInodeNumber, string name, int inodeNumber) {
+  inode_t parentInode;
+  readInode(super, parentInodeNumber, &parentInode);
+
+  if (parentInode.type & UFS_FLAG_INLINE) {
+    dir_ent_t entry = {};
+    strncpy(entry.name, name.c_str(), DIR_ENT_NAME_SIZE);
+    entry.inum = inodeNumber;
+    if (addInlineEntry(super, &parentInode, &entry, NULL) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    writeInode(super, parentInodeNumber, &parentInode);
+    return 0;
+  }
+
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+  int currentEntries = parentInode.size / sizeof(dir_ent_t);
+  int blockIndex = currentEntries / entriesPerBlock;
+
+  dir_ent_t entries[entriesPerBlock];
+  if (currentEntries % entriesPerBlock == 0) {
+    if (blockIndex >= DIRECT_PTRS) {
+      return -ENOTENOUGHSPACE;
+    }
+
+    vector<unsigned char> dataBitmap(super->data_bitmap_len * UFS_BLOCK_SIZE);
+    readDataBitmap(super, dataBitmap.data());
+    int newBlockNum = -1;
+    for (int dataIndex = 0; dataIndex < super->num_data; dataIndex++) {
+      if (!(dataBitmap[dataIndex / 8] & (1 << (dataIndex % 8)))) {
+	newBlockNum = dataIndex;
+	dataBitmap[dataIndex / 8] |= (1 << (dataIndex % 8));
+	break;
+      }
+    }
+    if (newBlockNum == -1) {
+      return -ENOTENOUGHSPACE;
+    }
+    writeDataBitmap(super, dataBitmap.data());
+
+    parentInode.direct[blockIndex] = newBlockNum + super->data_region_addr;
+    memset(entries, 0, sizeof(entries));
+  } else {
+    disk->readBlock(parentInode.direct[blockIndex], entries);
+  }
+
+  dir_ent_t *entry = &entries[currentEntries % entriesPerBlock];
+  memset(entry, 0, sizeof(dir_ent_t));
+  strncpy(entry->name, name.c_str(), DIR_ENT_NAME_SIZE);
+  entry->inum = inodeNumber;
+  if (writeInodeBlock(super, &parentInode, blockIndex, entries, NULL) < 0) {
+    return -ENOTENOUGHSPACE;
+  }
+
+  parentInode.size += sizeof(dir_ent_t);
+  writeInode(super, parentInodeNumber, &parentInode);
+  return 0;
+}
+
+
+// Append an entry to a directory kept in its inode. One that outgrows the
+// inode moves to a data block. Pass the caller's dataBitmap or NULL, like
+// writeInodeBlock.
+int LocalFileSystem::addInlineEntry(super_t *super, inode_t *inode, const dir_ent_t *entry,
+				    unsigned char *dataBitmap) {
+  unsigned char contents[UFS_BLOCK_SIZE] = {0};
+  memcpy(contents, inode->direct, inode->size);
+  memcpy(contents + inode->size, entry, sizeof(dir_ent_t));
+  int size = inode->size + sizeof(dir_ent_t);
+
+  if (size <= (int) UFS_INLINE_SIZE) {
+    memcpy(inode->direct, contents, size);
+    inode->size = size;
+    return 0;
+  }
+
+  vector<unsigned char> diskBitmap;
+  unsigned char *bitmap = dataBitmap;
+  if (bitmap == NULL) {
+    diskBitmap.resize(super->data_bitmap_len * UFS_BLOCK_SIZE);
+    bitmap = diskBitmap.data();
+    readDataBitmap(super, bitmap);
+  }
+  int newDataBlock = allocateDataBlock(super, bitmap);
+  if (newDataBlock < 0) {
+    return -ENOTENOUGHSPACE;
+  }
+  if (dataBitmap == NULL) {
+    writeDataBitmap(super, bitmap);
+  }
+  disk->writeBlock(newDataBlock, contents);
+
+  inode->type &= ~UFS_FLAG_INLINE;
+  memset(inode->direct, 0, sizeof(inode->direct));
+  inode->direct[0] = newDataBlock;
+  inode->size = size;
+  return 0;
+}
+
+
+// drop an entry from a directory by moving the last entry into its slot
+int LocalFileSystem::removeEntry(super_t *super, int parentInodeNumber, string name) {
+  inode_t parentInode;
+  readInode(super, parentInodeNumber, &parentInode);
+
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+  int numEntries = parentInode.size / sizeof(dir_ent_t);
+  dir_ent_t entries[numEntries];
+  read(parentInodeNumber, entries, parentInode.size);
+
+  int found = -1;
+  for (int i = 2; i < numEntries; i++) {
+    if (strncmp(entries[i].name, name.c_str(), DIR_ENT_NAME_SIZE) == 0) {
+      found = i;
+      break;
+    }
+  }
+  if (found < 0) {
+    return -ENOTFOUND;
+  }
+
+  int last = numEntries - 1;
+  entries[found] = entries[last];
+  parentInode.size -= sizeof(dir_ent_t);
+
+  if (parentInode.type & UFS_FLAG_INLINE) {
+    memset(parentInode.direct, 0, sizeof(parentInode.direct));
+    memcpy(parentInode.direct, entries, parentInode.size);
+    writeInode(super, parentInodeNumber, &parentInode);
+    return 0;
+  }
+
+  // only the block that received the last entry changes, unless it was in it
+  if (found != last) {
+    int blockIndex = found / entriesPerBlock;
+    dir_ent_t block[entriesPerBlock];
+    disk->readBlock(parentInode.direct[blockIndex], block);
+    block[found % entriesPerBlock] = entries[found];
+    if (writeInodeBlock(super, &parentInode, blockIndex, block, NULL) < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+  }
+
+  // the last block emptied out, give it back
+  if (last % entriesPerBlock == 0) {
+    vector<unsigned char> dataBitmap(super->data_bitmap_len * UFS_BLOCK_SIZE);
+    readDataBitmap(super, dataBitmap.data());
+    releaseDataBlock(super, dataBitmap.data(), parentInode.direct[last / entriesPerBlock]);
+    writeDataBitmap(super, dataBitmap.data());
+  }
+
+  writeInode(super, parentInodeNumber, &parentInode);
+  return 0;
+}
+
+
+int LocalFileSystem::clone(int srcInodeNumber, int dstParentInodeNumber, string dstName) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  // load in superblock
+  super_t super;
+  readSuperBlock(&super);
+
+  // only regular files can be cloned
+  inode_t source;
+  if (stat(srcInodeNumber, &source) != 0) {
+    return -EINVALIDINODE;
+  }
+  if (source.type != UFS_REGULAR_FILE) {
+    return -EINVALIDTYPE;
+  }
+
+  int existing = lookup(dstParentInodeNumber, dstName);
+  if (existing == srcInodeNumber) {
+    return existing;
+  }
+
+  int destination = create(dstParentInodeNumber, UFS_REGULAR_FILE, dstName);
+  if (destination < 0) {
+    return destination;
+  }
+
+  readInode(&super, srcInodeNumber, &source);
+  int blocks = blocksOf(&source);
+  bool canShare = super.refcount_addr != 0;
+  for (int i = 0; i < blocks && canShare; i++) {
+    canShare = references(&super, source.direct[i]) < UFS_REFCOUNT_MAX;
+  }
+
+  if (!canShare) {
+    // no refcount region, or a block is shared too often: copy the data
+    vector<unsigned char> buffer(source.size);
+    int bytesRead = read(srcInodeNumber, buffer.data(), source.size);
+    if (bytesRead < 0) {
+      return bytesRead;
+    }
+    int bytesWritten = write(destination, buffer.data(), bytesRead);
+    if (bytesWritten < bytesRead) {
+      return -ENOTENOUGHSPACE;
+    }
+    return destination;
+  }
+
+  // drop what the destination held before, then point it at our blocks
+  int ret = write(destination, NULL, 0);
+  if (ret < 0) {
+    return ret;
+  }
+  for (int i = 0; i < blocks; i++) {
+    setReferences(&super, source.direct[i], references(&super, source.direct[i]) + 1);
+  }
+
+  inode_t copy;
+  stat(destination, &copy);
+  copy.type = source.type;
+  copy.size = source.size;
+  for (int i = 0; i < DIRECT_PTRS; i++) {
+    copy.direct[i] = source.direct[i];
+  }
+  writeInode(&super, destination, &copy);
+
+  return destination;
+}
+
+
+int LocalFileSystem::relocate(int inodeNumber) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  super_t super;
+  readSuperBlock(&super);
+  if (inodeNumber < 0 || inodeNumber >= super.num_inodes) {
+    return -EINVALIDINODE;
+  }
+  vector<unsigned char> inodeBitmap(super.inode_bitmap_len * UFS_BLOCK_SIZE);
+  readInodeBitmap(&super, inodeBitmap.data());
+  if (!(inodeBitmap[inodeNumber / 8] & (1 << (inodeNumber % 8)))) {
+    return -ENOTALLOCATED;
+  }
+
+  inode_t inode;
+  readInode(&super, inodeNumber, &inode);
+  if ((inode.type & UFS_TYPE_MASK) != UFS_REGULAR_FILE) {
+    return -EINVALIDTYPE;
+  }
+
+  int blocks = blocksOf(&inode);
+  bool contiguous = true;
+  for (int i = 0; i < blocks; i++) {
+    if (references(&super, inode.direct[i]) > 0) {
+      return 0;
+    }
+    contiguous = contiguous && inode.direct[i] == inode.direct[0] + i;
+  }
+  if (contiguous) {
+    return 0;
+  }
+
+  // the first run of free blocks that holds the whole file
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+  int start = freeRun(&super, dataBitmap.data(), blocks);
+  if (start < 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < blocks; i++) {
+    int dataIndex = start + i;
+    int newDataBlock = dataIndex + super.data_region_addr;
+    unsigned char contents[UFS_BLOCK_SIZE];
+    disk->readBlock(inode.direct[i], contents);
+    disk->writeBlock(newDataBlock, contents);
+    releaseDataBlock(&super, dataBitmap.data(), inode.direct[i]);
+    dataBitmap[dataIndex / 8] |= (1 << (dataIndex % 8));
+    if (super.fingerprint_addr != 0) {
+      recordFingerprint(&super, XxHash64::hash(contents, UFS_BLOCK_SIZE), newDataBlock);
+    }
+    inode.direct[i] = newDataBlock;
+  }
+  writeDataBitmap(&super, dataBitmap.data());
+  writeInode(&super, inodeNumber, &inode);
+
+  return blocks;
+}
+
+
+// blocks needed for count entries of entrySize bytes
+static int blocksFor(long long count, long long entrySize) {
+  return (count * entrySize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+}
+
+
+int LocalFileSystem::resize(int numInodes, int numData) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  super_t super;
+  readSuperBlock(&super);
+  if (numInodes < super.num_inodes || numData < super.num_data ||
+      numInodes > RESIZE_MAX_INODES || numData > RESIZE_MAX_DATA_BLOCKS) {
+    return -EINVALIDSIZE;
+  }
+  if (numInodes == super.num_inodes && numData == super.num_data) {
+    return 0;
+  }
+
+  // the layout mkfs would give the new sizes, keeping the same regions
+  super_t grown = super;
+  grown.num_inodes = numInodes;
+  grown.num_data = numData;
+  int bitsPerBlock = 8 * UFS_BLOCK_SIZE;
+  grown.inode_bitmap_len = (numInodes + bitsPerBlock - 1) / bitsPerBlock;
+  grown.data_bitmap_addr = grown.inode_bitmap_addr + grown.inode_bitmap_len;
+  grown.data_bitmap_len = (numData + bitsPerBlock - 1) / bitsPerBlock;
+  grown.inode_region_addr = grown.data_bitmap_addr + grown.data_bitmap_len;
+  grown.inode_region_len = blocksFor(numInodes, sizeof(inode_t));
+  grown.data_region_addr = grown.inode_region_addr + grown.inode_region_len;
+  grown.data_region_len = numData;
+  long long totalBlocks = (long long) grown.data_region_addr + grown.data_region_len;
+  if (super.refcount_addr != 0) {
+    grown.refcount_addr = totalBlocks;
+    grown.refcount_len = blocksFor(numData, sizeof(refcount_t));
+    totalBlocks += grown.refcount_len;
+  }
+  if (super.fingerprint_addr != 0) {
+    grown.fingerprint_addr = totalBlocks;
+    grown.fingerprint_len = blocksFor(numData, sizeof(fingerprint_t));
+    totalBlocks += grown.fingerprint_len;
+  }
+  if (super.checksum_addr != 0) {
+    int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(uint32_t);
+    grown.checksum_addr = totalBlocks;
+    grown.checksum_len = 1;
+    while (totalBlocks + grown.checksum_len > grown.checksum_len * entriesPerBlock) {
+      grown.checksum_len++;
+    }
+    totalBlocks += grown.checksum_len;
+  }
+  // block numbers are ints, and so are the offsets Disk computes from them
+  if (totalBlocks > INT_MAX / UFS_BLOCK_SIZE) {
+    return -EINVALIDSIZE;
+  }
+
+  // Data blocks keep their addresses, except the ones the larger bitmaps
+  // and inode table now cover. Those move to free blocks of the new data
+  // region, which always has at least shift fresh blocks past its old end.
+  int shift = grown.data_region_addr - super.data_region_addr;
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+  map<int, int> moved;
+  int dataIndex = 0;
+  for (int oldIndex = 0; oldIndex < shift && oldIndex < super.num_data; oldIndex++) {
+    if (!(dataBitmap[oldIndex / 8] & (1 << (oldIndex % 8)))) {
+      continue;
+    }
+    for (; dataIndex < numData; dataIndex++) {
+      int used = dataIndex + shift;
+      if (used >= super.num_data || !(dataBitmap[used / 8] & (1 << (used % 8)))) {
+	break;
+      }
+    }
+    moved[oldIndex + super.data_region_addr] = grown.data_region_addr + dataIndex++;
+  }
+
+  // everything that names a data block is read in before it is overwritten
+  vector<unsigned char> inodeBitmap(grown.inode_bitmap_len * UFS_BLOCK_SIZE);
+  readInodeBitmap(&super, inodeBitmap.data());
+  vector<inode_t> inodes(grown.inode_region_len * (UFS_BLOCK_SIZE / sizeof(inode_t)));
+  readInodeRegion(&super, inodes.data());
+  vector<refcount_t> refcounts(super.refcount_len * (UFS_BLOCK_SIZE / sizeof(refcount_t)));
+  readRefcounts(&super, refcounts.data());
+  vector<fingerprint_t> fingerprints(super.fingerprint_len * (UFS_BLOCK_SIZE / sizeof(fingerprint_t)));
+  for (int i = 0; i < super.fingerprint_len; i++) {
+    disk->readBlock(super.fingerprint_addr + i, ((unsigned char *) fingerprints.data()) + i * UFS_BLOCK_SIZE);
+  }
+  snapshot_index_t index;
+  vector<snapshot_header_t> headers;
+  vector<vector<inode_t> > frozenInodes;
+  if (super.snapshot_addr != 0) {
+    disk->readBlock(super.snapshot_addr, &index);
+    for (int slot = 0; slot < (int) UFS_MAX_SNAPSHOTS; slot++) {
+      snapshot_header_t header;
+      memset(&header, 0, sizeof(header));
+      vector<inode_t> frozen;
+      if (index.entries[slot].id != 0) {
+	disk->readBlock(index.entries[slot].header, &header);
+	frozen.resize(header.inode_region_len * (UFS_BLOCK_SIZE / sizeof(inode_t)));
+	for (int i = 0; i < header.inode_region_len; i++) {
+	  disk->readBlock(header.blocks[header.inode_bitmap_len + i],
+			  ((unsigned char *) frozen.data()) + i * UFS_BLOCK_SIZE);
+	}
+      }
+      headers.push_back(header);
+      frozenInodes.push_back(frozen);
+    }
+  }
+
+  int oldBlocks = disk->numberOfBlocks();
+  disk->grow(totalBlocks);
+  if (super.checksum_addr != 0) {
+    disk->moveChecksums(grown.checksum_addr, grown.checksum_len);
+  }
+  map<int, int>::iterator move;
+  for (move = moved.begin(); move != moved.end(); move++) {
+    unsigned char contents[UFS_BLOCK_SIZE];
+    disk->readBlock(move->first, contents);
+    disk->writeBlock(move->second, contents);
+  }
+
+  // point the live inodes and the snapshots at the new places
+  for (int inum = 0; inum < super.num_inodes; inum++) {
+    if (inodeBitmap[inum / 8] & (1 << (inum % 8))) {
+      relocatedBlocks(&inodes[inum], moved);
+    }
+  }
+  if (super.snapshot_addr != 0) {
+    for (int slot = 0; slot < (int) UFS_MAX_SNAPSHOTS; slot++) {
+      if (index.entries[slot].id == 0) {
+	continue;
+      }
+      snapshot_header_t &header = headers[slot];
+      for (int inum = 0; inum < (int) frozenInodes[slot].size(); inum++) {
+	relocatedBlocks(&frozenInodes[slot][inum], moved);
+      }
+      for (int i = 0; i < header.inode_bitmap_len + header.inode_region_len; i++) {
+	if (moved.count(header.blocks[i])) {
+	  header.blocks[i] = moved[header.blocks[i]];
+	}
+      }
+      for (int i = 0; i < header.inode_region_len; i++) {
+	disk->writeBlock(header.blocks[header.inode_bitmap_len + i],
+			 ((unsigned char *) frozenInodes[slot].data()) + i * UFS_BLOCK_SIZE);
+      }
+      if (moved.count(index.entries[slot].header)) {
+	index.entries[slot].header = moved[index.entries[slot].header];
+      }
+      disk->writeBlock(index.entries[slot].header, &header);
+    }
+    if (moved.count(super.snapshot_addr)) {
+      grown.snapshot_addr = moved[super.snapshot_addr];
+    }
+    disk->writeBlock(grown.snapshot_addr, &index);
+  }
+
+  // the bitmap and refcounts are indexed from the start of the data region
+  vector<unsigned char> grownDataBitmap(grown.data_bitmap_len * UFS_BLOCK_SIZE, 0);
+  vector<refcount_t> grownRefcounts(grown.refcount_len * (UFS_BLOCK_SIZE / sizeof(refcount_t)), 0);
+  for (int oldIndex = 0; oldIndex < super.num_data; oldIndex++) {
+    if (!(dataBitmap[oldIndex / 8] & (1 << (oldIndex % 8)))) {
+      continue;
+    }
+    int blockNumber = oldIndex + super.data_region_addr;
+    if (moved.count(blockNumber)) {
+      blockNumber = moved[blockNumber];
+    }
+    int grownIndex = blockNumber - grown.data_region_addr;
+    grownDataBitmap[grownIndex / 8] |= (1 << (grownIndex % 8));
+    if (super.refcount_addr != 0) {
+      grownRefcounts[grownIndex] = refcounts[oldIndex];
+    }
+  }
+
+  // fingerprint slots depend on the number of data blocks
+  vector<fingerprint_t> grownFingerprints(grown.fingerprint_len * (UFS_BLOCK_SIZE / sizeof(fingerprint_t)));
+  memset(grownFingerprints.data(), 0, grownFingerprints.size() * sizeof(fingerprint_t));
+  for (size_t i = 0; i < fingerprints.size(); i++) {
+    if (fingerprints[i].block == 0) {
+      continue;
+    }
+    fingerprint_t fingerprint = fingerprints[i];
+    if (moved.count(fingerprint.block)) {
+      fingerprint.block = moved[fingerprint.block];
+    }
+    fingerprint_t &slot = grownFingerprints[fingerprint.hash % numData];
+    if (slot.block == 0) {
+      slot = fingerprint;
+    }
+  }
+
+  writeTable(grown.refcount_addr, grown.refcount_len, (unsigned char *) grownRefcounts.data(), oldBlocks);
+  writeTable(grown.fingerprint_addr, grown.fingerprint_len, (unsigned char *) grownFingerprints.data(), oldBlocks);
+  writeInodeRegion(&grown, inodes.data());
+  writeDataBitmap(&grown, grownDataBitmap.data());
+  writeInodeBitmap(&grown, inodeBitmap.data());
+  writeSuperBlock(&grown);
+
+  return moved.size();
+}
+
+
+// Write a table resize laid out anew. Blocks past freshBlocks were just
+// added to the image and read as zeros, so the empty parts of the table,
+// most of it when the image grew a lot, need not be written or logged.
+void LocalFileSystem::writeTable(int addr, int len, const unsigned char *table, int freshBlocks) {
+  static const unsigned char zeros[UFS_BLOCK_SIZE] = {0};
+  for (int i = 0; i < len; i++) {
+    const unsigned char *block = table + (size_t) i * UFS_BLOCK_SIZE;
+    if (addr + i >= freshBlocks && memcmp(block, zeros, UFS_BLOCK_SIZE) == 0) {
+      continue;
+    }
+    disk->writeBlock(addr + i, (void *) block);
+  }
+}
+
+
+// rewrite the direct pointers of an inode whose blocks moved
+void LocalFileSystem::relocatedBlocks(inode_t *inode, const map<int, int> &moved) {
+  int blocks = blocksOf(inode);
+  for (int i = 0; i < blocks; i++) {
+    map<int, int>::const_iterator move = moved.find(inode->direct[i]);
+    if (move != moved.end()) {
+      inode->direct[i] = move->second;
+    }
+  }
+}
+
+
+int LocalFileSystem::snapshot() {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  // load in superblock
+  super_t super;
+  readSuperBlock(&super);
+
+  int copies = super.inode_bitmap_len + super.inode_region_len;
+  if (super.refcount_addr == 0 ||
+      copies > (int) (sizeof(((snapshot_header_t *) 0)->blocks) / sizeof(int))) {
+    return -ENOTSUPPORTED;
+  }
+
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+
+  // the index is made on the first snapshot
+  snapshot_index_t index;
+  if (super.snapshot_addr == 0) {
+    int indexBlock = allocateDataBlock(&super, dataBitmap.data());
+    if (indexBlock < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+    memset(&index, 0, sizeof(index));
+    index.next_id = 1;
+    super.snapshot_addr = indexBlock;
+    writeSuperBlock(&super);
+  } else {
+    disk->readBlock(super.snapshot_addr, &index);
+  }
+
+  int slot = -1;
+  for (int i = 0; i < (int) UFS_MAX_SNAPSHOTS && slot < 0; i++) {
+    if (index.entries[i].id == 0) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    return -ENOTENOUGHSPACE;
+  }
+
+  // copy the inode bitmap and region into fresh blocks
+  snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.inode_bitmap_len = super.inode_bitmap_len;
+  header.inode_region_len = super.inode_region_len;
+  int headerBlock = allocateDataBlock(&super, dataBitmap.data());
+  for (int i = 0; i < copies; i++) {
+    header.blocks[i] = allocateDataBlock(&super, dataBitmap.data());
+    if (header.blocks[i] < 0 || headerBlock < 0) {
+      return -ENOTENOUGHSPACE;
+    }
+  }
+
+  vector<unsigned char> inodeBitmap(super.inode_bitmap_len * UFS_BLOCK_SIZE);
+  readInodeBitmap(&super, inodeBitmap.data());
+  vector<inode_t> inodes(super.inode_region_len * (UFS_BLOCK_SIZE / sizeof(inode_t)));
+  readInodeRegion(&super, inodes.data());
+
+  // every block a live inode uses gains the snapshot as an owner
+  vector<refcount_t> refcounts(super.refcount_len * (UFS_BLOCK_SIZE / sizeof(refcount_t)));
+  readRefcounts(&super, refcounts.data());
+  for (int inum = 0; inum < super.num_inodes; inum++) {
+    if (!(inodeBitmap[inum / 8] & (1 << (inum % 8)))) {
+      continue;
+    }
+    int blocks = blocksOf(&inodes[inum]);
+    for (int i = 0; i < blocks; i++) {
+      refcount_t &references = refcounts[inodes[inum].direct[i] - super.data_region_addr];
+      if (references == UFS_REFCOUNT_MAX) {
+	return -ENOTENOUGHSPACE;
+      }
+      references++;
+    }
+  }
+
+  for (int i = 0; i < super.inode_bitmap_len; i++) {
+    disk->writeBlock(header.blocks[i], inodeBitmap.data() + i * UFS_BLOCK_SIZE);
+  }
+  for (int i = 0; i < super.inode_region_len; i++) {
+    disk->writeBlock(header.blocks[super.inode_bitmap_len + i],
+		     ((unsigned char *) inodes.data()) + i * UFS_BLOCK_SIZE);
+  }
+  disk->writeBlock(headerBlock, &header);
+  writeRefcounts(&super, refcounts.data());
+  writeDataBitmap(&super, dataBitmap.data());
+
+  int id = index.next_id++;
+  index.entries[slot].id = id;
+  index.entries[slot].header = headerBlock;
+  index.entries[slot].created = time(NULL);
+  disk->writeBlock(super.snapshot_addr, &index);
+
+  return id;
+}
+
+
+int LocalFileSystem::deleteSnapshot(int id) {
+  // snapshots never change
+  if (!snapshotInodeBlocks.empty()) {
+    return -EREADONLY;
+  }
+
+  // load in superblock
+  super_t super;
+  readSuperBlock(&super);
+  if (super.snapshot_addr == 0 || id <= 0) {
+    return -ENOTFOUND;
+  }
+
+  snapshot_index_t index;
+  disk->readBlock(super.snapshot_addr, &index);
+  int slot = -1;
+  for (int i = 0; i < (int) UFS_MAX_SNAPSHOTS && slot < 0; i++) {
+    if (index.entries[i].id == id) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    return -ENOTFOUND;
+  }
+
+  snapshot_header_t header;
+  disk->readBlock(index.entries[slot].header, &header);
+  vector<unsigned char> inodeBitmap(header.inode_bitmap_len * UFS_BLOCK_SIZE);
+  for (int i = 0; i < header.inode_bitmap_len; i++) {
+    disk->readBlock(header.blocks[i], inodeBitmap.data() + i * UFS_BLOCK_SIZE);
+  }
+  vector<inode_t> inodes(header.inode_region_len * (UFS_BLOCK_SIZE / sizeof(inode_t)));
+  for (int i = 0; i < header.inode_region_len; i++) {
+    disk->readBlock(header.blocks[header.inode_bitmap_len + i],
+		    ((unsigned char *) inodes.data()) + i * UFS_BLOCK_SIZE);
+  }
+
+  vector<unsigned char> dataBitmap(super.data_bitmap_len * UFS_BLOCK_SIZE);
+  readDataBitmap(&super, dataBitmap.data());
+  vector<refcount_t> refcounts(super.refcount_len * (UFS_BLOCK_SIZE / sizeof(refcount_t)));
+  readRefcounts(&super, refcounts.data());
+
+  // drop the snapshot's reference, blocks nobody else uses are freed,
+  // the snapshot may predate a resize that added inodes
+  for (int inum = 0; inum < (int) inodes.size(); inum++) {
+    if (!(inodeBitmap[inum / 8] & (1 << (inum % 8)))) {
+      continue;
+    }
+    int blocks = blocksOf(&inodes[inum]);
+    for (int i = 0; i < blocks; i++) {
+      int dataIndex = inodes[inum].direct[i] - super.data_region_addr;
+      if (refcounts[dataIndex] > 0) {
+	refcounts[dataIndex]--;
+      } else {
+	forgetFingerprint(&super, inodes[inum].direct[i]);
+	dataBitmap[dataIndex / 8] &= ~(1 << (dataIndex % 8));
+      }
+    }
+  }
+
+  // and the copies themselves
+  int copies = header.inode_bitmap_len + header.inode_region_len;
+  for (int i = 0; i <= copies; i++) {
+    int blockNumber = (i == copies) ? index.entries[slot].header : header.blocks[i];
+    int dataIndex = blockNumber - super.data_region_addr;
+    dataBitmap[dataIndex / 8] &= ~(1 << (dataIndex % 8));
+  }
+
+  writeRefcounts(&super, refcounts.data());
+  writeDataBitmap(&super, dataBitmap.data());
+  memset(&index.entries[slot], 0, sizeof(snapshot_ent_t));
+  disk->writeBlock(super.snapshot_addr, &index);
+
+  return 0;
+}
+
+
+vector<snapshot_ent_t> LocalFileSystem::snapshots() {
+  // load in superblock
+  super_t super;
+  readSuperBlock(&super);
+
+  vector<snapshot_ent_t> result;
+  if (super.snapshot_addr == 0) {
+    return result;
+  }
+
+  snapshot_index_t index;
+  disk->readBlock(super.snapshot_addr, &index);
+  for (int i = 0; i < (int) UFS_MAX_SNAPSHOTS; i++) {
+    if (index.entries[i].id != 0) {
+      result.push_back(index.entries[i]);
+    }
+  }
+  sort(result.begin(), result.end(),
+       [](const snapshot_ent_t &a, const snapshot_ent_t &b) { return a.id < b.id; });
+  return result;
+}
+
+
+LocalFileSystem *LocalFileSystem::openSnapshot(int id) {
+  vector<snapshot_ent_t> all = snapshots();
+  for (size_t i = 0; i < all.size(); i++) {
+    if (all[i].id != id) {
+      continue;
+    }
+
+    snapshot_header_t header;
+    disk->readBlock(all[i].header, &header);
+
+    LocalFileSystem *view = new LocalFileSystem(disk);
+    for (int block = 0; block < header.inode_region_len; block++) {
+      view->snapshotInodeBlocks.push_back(header.blocks[header.inode_bitmap_len + block]);
+    }
+    return view;
+  }
+  return NULL;
+}
@@ -0,0 +1,161 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "Lz4.h"
+
+#define MIN_MATCH (4)
+// the format requires the last bytes of a block to be literals
+#define LAST_LITERALS (5)
+#define MATCH_SEARCH_LIMIT (12)
+#define MAX_DISTANCE (65535)
+#define HASH_BITS (12)
+
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline int hashOf(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// lengths of 15 and more continue in bytes of 255
+static bool writeLength(int length, unsigned char **out, unsigned char *end) {
+  for (; length >= 255; length -= 255) {
+    if (*out >= end) {
+      return false;
+    }
+    *(*out)++ = 255;
+  }
+  if (*out >= end) {
+    return false;
+  }
+  *(*out)++ = (unsigned char) length;
+  return true;
+}
+
+static bool writeSequence(const unsigned char *literals, int literalLength, int matchLength,
+			  int offset, unsigned char **out, unsigned char *end) {
+  if (*out >= end) {
+    return false;
+  }
+  unsigned char *token = (*out)++;
+  *token = (literalLength >= 15 ? 15 : literalLength) << 4;
+  if (literalLength >= 15 && !writeLength(literalLength - 15, out, end)) {
+    return false;
+  }
+  if (end - *out < literalLength) {
+    return false;
+  }
+  memcpy(*out, literals, literalLength);
+  *out += literalLength;
+
+  // the last sequence is literals only
+  if (matchLength == 0) {
+    return true;
+  }
+  if (end - *out < 2) {
+    return false;
+  }
+  *(*out)++ = offset & 0xff;
+  *(*out)++ = offset >> 8;
+  int stored = matchLength - MIN_MATCH;
+  *token |= (stored >= 15 ? 15 : stored);
+  if (stored >= 15 && !writeLength(stored - 15, out, end)) {
+    return false;
+  }
+  return true;
+}
+
+int Lz4::compress(const unsigned char *src, int srcSize, unsigned char *dst, int dstCapacity) {
+  int table[1 << HASH_BITS];
+  memset(table, -1, sizeof(table));
+
+  unsigned char *out = dst;
+  unsigned char *end = dst + dstCapacity;
+  int anchor = 0;
+  int pos = 0;
+  int matchLimit = srcSize - LAST_LITERALS;
+
+  while (pos < srcSize - MATCH_SEARCH_LIMIT) {
+    uint32_t sequence = read32(src + pos);
+    int h = hashOf(sequence);
+    int candidate = table[h];
+    table[h] = pos;
+    if (candidate < 0 || pos - candidate > MAX_DISTANCE || read32(src + candidate) != sequence) {
+      pos++;
+      continue;
+    }
+
+    int length = MIN_MATCH;
+    while (pos + length < matchLimit && src[candidate + length] == src[pos + length]) {
+      length++;
+    }
+    if (!writeSequence(src + anchor, pos - anchor, length, pos - candidate, &out, end)) {
+      return -1;
+    }
+    pos += length;
+    anchor = pos;
+  }
+
+  if (!writeSequence(src + anchor, srcSize - anchor, 0, 0, &out, end)) {
+    return -1;
+  }
+  return out - dst;
+}
+
+static bool readLength(int *length, const unsigned char **in, const unsigned char *end) {
+  unsigned char next;
+  do {
+    if (*in >= end) {
+      return false;
+    }
+    next = *(*in)++;
+    *length += next;
+  } while (next == 255);
+  return true;
+}
+
+int Lz4::decompress(const unsigned char *src, int srcSize, unsigned char *dst, int dstSize) {
+  const unsigned char *in = src;
+  const unsigned char *inEnd = src + srcSize;
+  int pos = 0;
+
+  while (in < inEnd) {
+    unsigned char token = *in++;
+    int literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(&literalLength, &in, inEnd)) {
+      return -1;
+    }
+    if (literalLength > inEnd - in || literalLength > dstSize - pos) {
+      return -1;
+    }
+    memcpy(dst + pos, in, literalLength);
+    in += literalLength;
+    pos += literalLength;
+
+    if (in == inEnd) {
+      break;
+    }
+    if (inEnd - in < 2) {
+      return -1;
+    }
+    int offset = in[0] | (in[1] << 8);
+    in += 2;
+    int matchLength = token & 15;
+    if (matchLength == 15 && !readLength(&matchLength, &in, inEnd)) {
+      return -1;
+    }
+    matchLength += MIN_MATCH;
+    if (offset == 0 || offset > pos || matchLength > dstSize - pos) {
+      return -1;
+    }
+    // matches may overlap the bytes they produce, so copy forward
+    for (int i = 0; i < matchLength; i++, pos++) {
+      dst[pos] = dst[pos - offset];
+    }
+  }
+
+  return pos == dstSize ? pos : -1;
+}
@@ -0,0 +1,462 @@
+#include <iostream>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "MirroredDisk.h"
+#include "dthread.h"
+#include "ufs.h"
+
+using namespace std;
+
+// Whether a mirror of size bytes starts with a superblock that lays out
+// its regions the way mkfs does, all of them inside the mirror.
+static bool validSuperBlock(int fd, off_t size, int blockSize) {
+  if (size < blockSize || size % blockSize != 0) {
+    return false;
+  }
+  vector<unsigned char> block(blockSize);
+  if (pread(fd, block.data(), blockSize, 0) != blockSize) {
+    return false;
+  }
+  super_t super;
+  memcpy(&super, block.data(), sizeof(super));
+  long long blocks = size / blockSize;
+  if (super.inode_bitmap_addr != 1 || super.inode_bitmap_len <= 0 || super.data_bitmap_len <= 0 ||
+      super.inode_region_len <= 0 || super.data_region_len <= 0 ||
+      super.data_bitmap_addr != super.inode_bitmap_addr + super.inode_bitmap_len ||
+      super.inode_region_addr != super.data_bitmap_addr + super.data_bitmap_len ||
+      super.data_region_addr != super.inode_region_addr + super.inode_region_len ||
+      (long long) super.data_region_addr + super.data_region_len > blocks) {
+    return false;
+  }
+  int optional[][2] = {{super.refcount_addr, super.refcount_len},
+		       {super.fingerprint_addr, super.fingerprint_len},
+		       {super.checksum_addr, super.checksum_len}};
+  for (int i = 0; i < 3; i++) {
+    if (optional[i][0] < 0 || optional[i][1] < 0 || (long long) optional[i][0] + optional[i][1] > blocks) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The mirror the others are rebuilt from: the largest one that holds a
+// valid image. Nothing is written before it is found, so a missing or
+// empty mirror never wipes the good ones.
+static int referenceMirror(const vector<string> &mirrorFiles, int blockSize, off_t *size) {
+  int reference = -1;
+  off_t referenceSize = 0;
+  for (size_t i = 0; i < mirrorFiles.size(); i++) {
+    int fd = open(mirrorFiles[i].c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) == 0 && validSuperBlock(fd, stat.st_size, blockSize) &&
+	(reference < 0 || stat.st_size > referenceSize)) {
+      reference = i;
+      referenceSize = stat.st_size;
+    }
+    close(fd);
+  }
+  if (reference < 0) {
+    cerr << "no mirror holds a valid image, refusing to start" << endl;
+    exit(1);
+  }
+  if (size != NULL) {
+    *size = referenceSize;
+  }
+  return reference;
+}
+
+// the reference mirror's size in bytes
+static off_t mirrorSize(const vector<string> &mirrorFiles, int blockSize) {
+  off_t size;
+  referenceMirror(mirrorFiles, blockSize, &size);
+  return size;
+}
+
+static string joined(const vector<string> &mirrorFiles) {
+  string result;
+  for (size_t i = 0; i < mirrorFiles.size(); i++) {
+    result += (i > 0 ? "," : "") + mirrorFiles[i];
+  }
+  return result;
+}
+
+MirroredDisk::MirroredDisk(vector<string> mirrorFiles, int blockSize)
+  : Disk(joined(mirrorFiles), blockSize, mirrorSize(mirrorFiles, blockSize)) {
+  this->mirrorFiles = mirrorFiles;
+  this->reference = referenceMirror(mirrorFiles, blockSize, NULL);
+  pthread_mutex_init(&stateLock, NULL);
+  pthread_mutex_init(&writeLock, NULL);
+  pthread_cond_init(&stopped, NULL);
+  this->nextMirror = 0;
+  this->stopping = false;
+  this->rebuilding = false;
+  this->writes = 0;
+
+  // A mirror is missing its state, or still marked dirty, when the last
+  // run stopped with writes that may have reached only some mirrors.
+  bool wasClean = true;
+  int mirrors = mirrorFiles.size();
+  for (int i = 0; i < mirrors; i++) {
+    int fd = open(mirrorFiles[i].c_str(), O_RDWR | O_CREAT, 0644);
+    int stateFd = open((mirrorFiles[i] + MIRROR_STATE_SUFFIX).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || stateFd < 0) {
+      cerr << "could not open " << mirrorFiles[i] << endl;
+      exit(1);
+    }
+    char state;
+    if (pread(stateFd, &state, 1, 0) != 1 || state != MIRROR_CLEAN) {
+      wasClean = false;
+    }
+    fds.push_back(fd);
+    stateFds.push_back(stateFd);
+  }
+  inFlight.assign(mirrors, 0);
+  stale.assign(mirrors, false);
+  markState(MIRROR_DIRTY);
+
+  // a replaced mirror is empty, or at least not the same file system
+  vector<unsigned char> referenceBlock(blockSize);
+  vector<unsigned char> superBlock(blockSize);
+  if (pread(fds[reference], referenceBlock.data(), blockSize, 0) != blockSize) {
+    cerr << "Could not read file " << mirrorFiles[reference] << endl;
+    exit(1);
+  }
+  for (int i = 0; i < mirrors; i++) {
+    if (i == reference) {
+      continue;
+    }
+    if (lseek(fds[i], 0, SEEK_END) != imageFileSize ||
+	pread(fds[i], superBlock.data(), blockSize, 0) != blockSize ||
+	memcmp(superBlock.data(), referenceBlock.data(), blockSize) != 0) {
+      if (ftruncate(fds[i], imageFileSize) != 0) {
+	cerr << "Could not resize mirror " << mirrorFiles[i] << endl;
+	exit(1);
+      }
+      stale[i] = true;
+      rebuilding = true;
+      cerr << "rebuilding mirror " << mirrorFiles[i] << " from " << mirrorFiles[reference] << endl;
+    } else if (!wasClean) {
+      // same size and superblock, but some data blocks may differ
+      stale[i] = true;
+      rebuilding = true;
+      cerr << "mirrors were not stopped cleanly, resynchronising " << mirrorFiles[i]
+	   << " from " << mirrorFiles[reference] << endl;
+    }
+  }
+
+  this->rebuildEnd = numberOfBlocks();
+  this->rebuilt = rebuilding ? 0 : rebuildEnd;
+  if (rebuilding) {
+    dthread_create(&rebuilder, NULL, rebuild, this);
+  }
+  dthread_create(&cleaner, NULL, clean, this);
+}
+
+MirroredDisk::~MirroredDisk() {
+  dthread_mutex_lock(&stateLock);
+  stopping = true;
+  dthread_cond_broadcast(&stopped);
+  dthread_mutex_unlock(&stateLock);
+  if (rebuilding) {
+    pthread_join(rebuilder, NULL);
+  }
+  pthread_join(cleaner, NULL);
+
+  dthread_mutex_lock(&writeLock);
+  if (inSync()) {
+    sync();
+    markState(MIRROR_CLEAN);
+  }
+  dthread_mutex_unlock(&writeLock);
+  for (size_t i = 0; i < fds.size(); i++) {
+    close(fds[i]);
+    close(stateFds[i]);
+  }
+}
+
+// every mirror holds every block, no rebuild left to do
+bool MirroredDisk::inSync() {
+  dthread_mutex_lock(&stateLock);
+  bool inSync = rebuilt >= rebuildEnd;
+  dthread_mutex_unlock(&stateLock);
+  return inSync;
+}
+
+// Write state into every mirror's state file, durably. Called with
+// writeLock held.
+void MirroredDisk::markState(char state) {
+  for (size_t i = 0; i < stateFds.size(); i++) {
+    if (pwrite(stateFds[i], &state, 1, 0) != 1 || fdatasync(stateFds[i]) != 0) {
+      cerr << "Could not write file " << mirrorFiles[i] << MIRROR_STATE_SUFFIX << endl;
+      exit(1);
+    }
+  }
+  dirty = (state == MIRROR_DIRTY);
+}
+
+// a write is about to start, called with writeLock held
+void MirroredDisk::startWrite() {
+  if (!dirty) {
+    markState(MIRROR_DIRTY);
+  }
+  writes++;
+}
+
+// Mark the mirrors clean once writes have paused for MIRROR_CLEAN_MS.
+// Marking them on every sync would cost two more syncs per transaction.
+void *MirroredDisk::clean(void *arg) {
+  MirroredDisk *self = (MirroredDisk *) arg;
+  unsigned long seen = 0;
+  while (true) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += MIRROR_CLEAN_MS / 1000;
+    deadline.tv_nsec += (long) (MIRROR_CLEAN_MS % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+    dthread_mutex_lock(&self->stateLock);
+    if (!self->stopping) {
+      dthread_cond_timedwait(&self->stopped, &self->stateLock, &deadline);
+    }
+    bool stopping = self->stopping;
+    dthread_mutex_unlock(&self->stateLock);
+    if (stopping) {
+      return NULL;
+    }
+
+    // holding writeLock, every write so far is on the mirrors once synced
+    dthread_mutex_lock(&self->writeLock);
+    if (self->dirty && self->writes == seen && self->inSync()) {
+      self->sync();
+      self->markState(MIRROR_CLEAN);
+    }
+    seen = self->writes;
+    dthread_mutex_unlock(&self->writeLock);
+  }
+}
+
+// The current mirror with the fewest blocks queued or in flight, which
+// then counts count more of them until finished.
+int MirroredDisk::pickMirror(int firstBlock, int count) {
+  dthread_mutex_lock(&stateLock);
+  int mirrors = fds.size();
+  int best = -1;
+  for (int i = 0; i < mirrors; i++) {
+    int mirror = (nextMirror + i) % mirrors;
+    if (stale[mirror] && firstBlock + count > rebuilt) {
+      continue;
+    }
+    if (best < 0 || inFlight[mirror] < inFlight[best]) {
+      best = mirror;
+    }
+  }
+  nextMirror = (nextMirror + 1) % mirrors;
+  inFlight[best] += count;
+  dthread_mutex_unlock(&stateLock);
+  return best;
+}
+
+void MirroredDisk::finished(int mirror, int count) {
+  dthread_mutex_lock(&stateLock);
+  inFlight[mirror] -= count;
+  dthread_mutex_unlock(&stateLock);
+}
+
+void MirroredDisk::readRaw(int blockNumber, void *buffer) {
+  int mirror = pickMirror(blockNumber, 1);
+  if (pread(fds[mirror], buffer, blockSize, (off_t) blockNumber * blockSize) != blockSize) {
+    cerr << "Could not read file" << endl;
+    exit(1);
+  }
+  finished(mirror, 1);
+}
+
+void MirroredDisk::writeRaw(int blockNumber, const void *buffer) {
+  dthread_mutex_lock(&writeLock);
+  startWrite();
+  for (size_t i = 0; i < fds.size(); i++) {
+    if (pwrite(fds[i], buffer, blockSize, (off_t) blockNumber * blockSize) != blockSize) {
+      cerr << "Could not write file " << mirrorFiles[i] << endl;
+      exit(1);
+    }
+  }
+  dthread_mutex_unlock(&writeLock);
+}
+
+// Runs are cut into pieces of about an equal share per mirror, so even a
+// single long run is read from every mirror at once.
+void MirroredDisk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  vector<struct MirrorTransfer> shares(fds.size());
+  int pieceBlocks = max(1, (int) ((blockNumbers.size() + fds.size() - 1) / fds.size()));
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    for (int done = 0; done < batchRuns[i].second; done += pieceBlocks) {
+      int first = batchRuns[i].first + done;
+      int count = min(batchRuns[i].second - done, pieceBlocks);
+      int mirror = pickMirror(blockNumbers[first], count);
+      for (int j = first; j < first + count; j++) {
+	shares[mirror].blocks.push_back(make_pair(j, blockNumbers[j]));
+      }
+    }
+  }
+  for (size_t i = 0; i < shares.size(); i++) {
+    shares[i].write = false;
+    shares[i].buffer = buffer;
+  }
+  transfer(shares);
+}
+
+void MirroredDisk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  vector<struct MirrorTransfer> shares(fds.size());
+  for (size_t i = 0; i < shares.size(); i++) {
+    for (size_t j = 0; j < blockNumbers.size(); j++) {
+      shares[i].blocks.push_back(make_pair((int) j, blockNumbers[j]));
+    }
+    shares[i].write = true;
+    shares[i].buffer = (unsigned char *) buffer;
+  }
+  dthread_mutex_lock(&writeLock);
+  startWrite();
+  transfer(shares);
+  dthread_mutex_unlock(&writeLock);
+}
+
+// every mirror's share at once, this thread taking the last one
+void MirroredDisk::transfer(vector<struct MirrorTransfer> &shares) {
+  vector<int> busy;
+  for (size_t i = 0; i < shares.size(); i++) {
+    shares[i].disk = this;
+    shares[i].mirror = i;
+    if (!shares[i].blocks.empty()) {
+      busy.push_back(i);
+    }
+  }
+  if (busy.empty()) {
+    return;
+  }
+
+  vector<pthread_t> threads(busy.size() - 1);
+  for (size_t i = 0; i < threads.size(); i++) {
+    dthread_create(&threads[i], NULL, transferMirror, &shares[busy[i]]);
+  }
+  transferMirror(&shares[busy.back()]);
+  for (size_t i = 0; i < threads.size(); i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+// blocks adjacent both on the mirror and in the buffer go in one call
+void *MirroredDisk::transferMirror(void *arg) {
+  struct MirrorTransfer *share = (struct MirrorTransfer *) arg;
+  int blockSize = share->disk->blockSize;
+  int fd = share->disk->fds[share->mirror];
+  size_t first = 0;
+  while (first < share->blocks.size()) {
+    size_t end = first + 1;
+    while (end < share->blocks.size() &&
+	   share->blocks[end].first == share->blocks[end - 1].first + 1 &&
+	   share->blocks[end].second == share->blocks[end - 1].second + 1) {
+      end++;
+    }
+    unsigned char *memory = share->buffer + (size_t) share->blocks[first].first * blockSize;
+    ssize_t length = (ssize_t) (end - first) * blockSize;
+    off_t offset = (off_t) share->blocks[first].second * blockSize;
+    ssize_t ret = share->write ? pwrite(fd, memory, length, offset) : pread(fd, memory, length, offset);
+    if (ret != length) {
+      cerr << (share->write ? "Could not write file " : "Could not read file ")
+	   << share->disk->mirrorFiles[share->mirror] << endl;
+      exit(1);
+    }
+    first = end;
+  }
+  if (!share->write) {
+    share->disk->finished(share->mirror, share->blocks.size());
+  }
+  return NULL;
+}
+
+void MirroredDisk::sync() {
+  for (size_t i = 0; i < fds.size(); i++) {
+    fsync(fds[i]);
+  }
+}
+
+// blocks past the old end are zero everywhere, so they need no rebuild
+void MirroredDisk::extend(off_t size) {
+  dthread_mutex_lock(&writeLock);
+  startWrite();
+  for (size_t i = 0; i < fds.size(); i++) {
+    if (ftruncate(fds[i], size) != 0) {
+      perror("grow::ftruncate");
+      cerr << "Could not grow image file " << mirrorFiles[i] << endl;
+      exit(1);
+    }
+  }
+  dthread_mutex_unlock(&writeLock);
+}
+
+// copy the reference mirror onto the stale ones, a batch at a time
+void *MirroredDisk::rebuild(void *arg) {
+  MirroredDisk *self = (MirroredDisk *) arg;
+  int blockSize = self->blockSize;
+  vector<unsigned char> buffer((size_t) MIRROR_REBUILD_BLOCKS * blockSize);
+  while (true) {
+    // the copy loads the reference mirror like any read would
+    dthread_mutex_lock(&self->stateLock);
+    int first = self->rebuilt;
+    int count = min(MIRROR_REBUILD_BLOCKS, self->rebuildEnd - first);
+    bool done = self->stopping || count <= 0;
+    if (!done) {
+      self->inFlight[self->reference] += count;
+    }
+    dthread_mutex_unlock(&self->stateLock);
+    if (done) {
+      break;
+    }
+
+    ssize_t length = (ssize_t) count * blockSize;
+    off_t offset = (off_t) first * blockSize;
+    dthread_mutex_lock(&self->writeLock);
+    if (pread(self->fds[self->reference], buffer.data(), length, offset) != length) {
+      cerr << "Could not read file " << self->mirrorFiles[self->reference] << endl;
+      exit(1);
+    }
+    for (size_t i = 0; i < self->fds.size(); i++) {
+      if (self->stale[i] && pwrite(self->fds[i], buffer.data(), length, offset) != length) {
+	cerr << "Could not write file " << self->mirrorFiles[i] << endl;
+	exit(1);
+      }
+    }
+    dthread_mutex_unlock(&self->writeLock);
+
+    dthread_mutex_lock(&self->stateLock);
+    self->inFlight[self->reference] -= count;
+    self->rebuilt = first + count;
+    dthread_mutex_unlock(&self->stateLock);
+  }
+
+  if (self->rebuilt < self->rebuildEnd) {
+    return NULL;
+  }
+  for (size_t i = 0; i < self->fds.size(); i++) {
+    if (self->stale[i]) {
+      fsync(self->fds[i]);
+      cerr << "mirror " << self->mirrorFiles[i] << " rebuilt" << endl;
+    }
+  }
+  dthread_mutex_lock(&self->stateLock);
+  self->stale.assign(self->fds.size(), false);
+  dthread_mutex_unlock(&self->stateLock);
+  return NULL;
+}
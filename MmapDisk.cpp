@@ -0,0 +1,100 @@
+#include <iostream>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "MmapDisk.h"
+
+using namespace std;
+
+MmapDisk::MmapDisk(string imageFile, int blockSize) : Disk(imageFile, blockSize) {
+  this->fd = open(imageFile.c_str(), O_RDWR);
+  if (this->fd < 0) {
+    cerr << "could not open " << imageFile << endl;
+    exit(1);
+  }
+  this->image = NULL;
+  this->firstDirty = 1;
+  this->lastDirty = 0;
+  map();
+}
+
+MmapDisk::~MmapDisk() {
+  sync();
+  munmap(image, imageFileSize);
+  close(fd);
+}
+
+void MmapDisk::map() {
+  image = (unsigned char *) mmap(NULL, imageFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (image == MAP_FAILED) {
+    perror("mmap");
+    cerr << "Could not map image file " << imageFile << endl;
+    exit(1);
+  }
+}
+
+void MmapDisk::grow(int numberOfBlocks) {
+  if (numberOfBlocks <= this->numberOfBlocks()) {
+    return;
+  }
+  sync();
+  munmap(image, imageFileSize);
+  Disk::grow(numberOfBlocks);
+  map();
+}
+
+void MmapDisk::readRaw(int blockNumber, void *buffer) {
+  memcpy(buffer, image + (off_t) blockNumber * blockSize, blockSize);
+}
+
+void MmapDisk::writeRaw(int blockNumber, const void *buffer) {
+  memcpy(image + (off_t) blockNumber * blockSize, buffer, blockSize);
+  if (firstDirty > lastDirty) {
+    firstDirty = lastDirty = blockNumber;
+  } else {
+    firstDirty = min(firstDirty, blockNumber);
+    lastDirty = max(lastDirty, blockNumber);
+  }
+}
+
+// A run of adjacent blocks is one memcpy. Page faults would read the
+// runs one after another, so the kernel is asked for all of them first.
+void MmapDisk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 1; i < batchRuns.size(); i++) {
+    madvise(image + (off_t) blockNumbers[batchRuns[i].first] * blockSize,
+	    (size_t) batchRuns[i].second * blockSize, MADV_WILLNEED);
+  }
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    memcpy(buffer + (size_t) batchRuns[i].first * blockSize,
+	   image + (off_t) blockNumbers[batchRuns[i].first] * blockSize,
+	   (size_t) batchRuns[i].second * blockSize);
+  }
+}
+
+void MmapDisk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    writeRaw(blockNumbers[i], buffer + i * blockSize);
+  }
+}
+
+// blocks are a multiple of the page size, so the range is page aligned
+void MmapDisk::sync() {
+  if (firstDirty > lastDirty) {
+    return;
+  }
+  off_t offset = (off_t) firstDirty * blockSize;
+  size_t length = (size_t) (lastDirty - firstDirty + 1) * blockSize;
+  if (msync(image + offset, length, MS_SYNC) != 0) {
+    perror("msync");
+    cerr << "Could not sync image file " << imageFile << endl;
+    exit(1);
+  }
+  firstDirty = 1;
+  lastDirty = 0;
+}
@@ -0,0 +1,157 @@
+#include <time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "ReadProxyService.h"
+#include "ClientError.h"
+#include "dthread.h"
+
+using namespace std;
+
+static long elapsedMs(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+ReadProxyService::ReadProxyService(vector<string> peers, int percentile, int initialDelayMs, int timeoutMs)
+  : HttpService("/ds3/") {
+  if (peers.size() == 0) {
+    cerr << "the read proxy needs at least one peer" << endl;
+    exit(1);
+  }
+  this->m_peers = peers;
+  this->m_percentile = max(1, min(percentile, 100));
+  this->m_initialDelayMs = initialDelayMs;
+  this->m_timeoutMs = timeoutMs;
+
+  pthread_mutex_init(&m_lock, NULL);
+  m_nextPeer = 0;
+  m_numLatencies = 0;
+  m_nextLatency = 0;
+  m_requests = 0;
+  m_hedged = 0;
+  m_hedgeWins = 0;
+  m_failures = 0;
+}
+
+void ReadProxyService::get(HTTPRequest *request, HTTPResponse *response) {
+  map<string, string> params = request->getParams();
+  if (params.find("stats") != params.end()) {
+    response->setBody(stats());
+    return;
+  }
+
+  // forward the path along with any query string
+  string path = request->getUrl();
+
+  dthread_mutex_lock(&m_lock);
+  string primary = m_peers[m_nextPeer % m_peers.size()];
+  string secondary = m_peers[(m_nextPeer + 1) % m_peers.size()];
+  m_nextPeer++;
+  m_requests++;
+  dthread_mutex_unlock(&m_lock);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  map<string, string> headers;
+  ReplicaRequestGroup *group = new ReplicaRequestGroup();
+  group->start(primary, "GET", path, "", headers);
+
+  // Hedge: give the primary until the delay, then race a second peer. A
+  // 5xx from the primary ends the wait early, and never counts as the
+  // answer while the other peer may still give a good one.
+  bool hedged = false;
+  int delay = hedgeDelayMs();
+  if (!group->waitFor(1, false, delay) && m_peers.size() > 1) {
+    hedged = true;
+    group->start(secondary, "GET", path, "", headers);
+  }
+  group->waitFor(1, false, max(0L, m_timeoutMs - elapsedMs(&start)));
+
+  vector<ReplicaResponse> answers = group->responses();
+  group->cancel();
+  group->release();
+
+  // the first answer that isn't a 5xx, or else the first error
+  int winner = answers.size() == 0 ? -1 : 0;
+  for (size_t idx = 0; idx < answers.size(); idx++) {
+    if (answers[idx].status < 500) {
+      winner = idx;
+      break;
+    }
+  }
+
+  dthread_mutex_lock(&m_lock);
+  if (hedged) {
+    m_hedged++;
+  }
+  if (winner < 0 || answers[winner].status >= 500) {
+    m_failures++;
+  } else if (answers[winner].peer != primary) {
+    m_hedgeWins++;
+  }
+  dthread_mutex_unlock(&m_lock);
+
+  // The primary's latency, or when it lost or never answered, the time
+  // it has taken so far, which it would have taken at least. Leaving out
+  // the requests it lost would keep only the fast ones and pull the
+  // delay down, hedging more and more requests.
+  recordLatency(elapsedMs(&start));
+
+  if (winner < 0) {
+    throw ClientError::serviceUnavailable();
+  }
+
+  response->setStatus(answers[winner].status);
+  response->setBody(answers[winner].body);
+}
+
+// the configured percentile of recent primary latencies, see get
+int ReadProxyService::hedgeDelayMs() {
+  dthread_mutex_lock(&m_lock);
+  if (m_numLatencies < HEDGE_MIN_SAMPLES) {
+    dthread_mutex_unlock(&m_lock);
+    return m_initialDelayMs;
+  }
+  vector<int> sorted(m_latencies, m_latencies + m_numLatencies);
+  dthread_mutex_unlock(&m_lock);
+
+  sort(sorted.begin(), sorted.end());
+  int idx = (sorted.size() * m_percentile) / 100;
+  if (idx >= (int) sorted.size()) {
+    idx = sorted.size() - 1;
+  }
+  return max(1, sorted[idx]);
+}
+
+void ReadProxyService::recordLatency(int latencyMs) {
+  dthread_mutex_lock(&m_lock);
+  m_latencies[m_nextLatency] = latencyMs;
+  m_nextLatency = (m_nextLatency + 1) % HEDGE_LATENCY_SAMPLES;
+  if (m_numLatencies < HEDGE_LATENCY_SAMPLES) {
+    m_numLatencies++;
+  }
+  dthread_mutex_unlock(&m_lock);
+}
+
+string ReadProxyService::stats() {
+  int delay = hedgeDelayMs();
+
+  dthread_mutex_lock(&m_lock);
+  stringstream out;
+  out << "requests " << m_requests << "\n";
+  out << "hedged " << m_hedged << "\n";
+  out << "hedge_rate " << (m_requests == 0 ? 0.0 : (double) m_hedged / m_requests) << "\n";
+  out << "hedge_wins " << m_hedgeWins << "\n";
+  out << "failures " << m_failures << "\n";
+  out << "percentile " << m_percentile << "\n";
+  out << "hedge_delay_ms " << delay << "\n";
+  dthread_mutex_unlock(&m_lock);
+
+  return out.str();
+}
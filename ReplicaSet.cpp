@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <iostream>
+
+#include "ReplicaSet.h"
+#include "HTTPClientResponse.h"
+#include "dthread.h"
+
+using namespace std;
+
+ReplicaRequestGroup::ReplicaRequestGroup() {
+  pthread_mutex_init(&m_lock, NULL);
+  pthread_cond_init(&m_answered, NULL);
+  // the caller holds the first reference
+  m_refs = 1;
+  m_started = 0;
+  m_finished = 0;
+  m_succeeded = 0;
+  m_usable = 0;
+  m_cancelled = false;
+}
+
+ReplicaRequestGroup::~ReplicaRequestGroup() {
+  pthread_cond_destroy(&m_answered);
+  pthread_mutex_destroy(&m_lock);
+}
+
+void ReplicaRequestGroup::start(string peer, string method, string path,
+				string body, map<string, string> headers) {
+  struct Call *call = new struct Call;
+  call->group = this;
+  call->peer = peer;
+  call->method = method;
+  call->path = path;
+  call->body = body;
+  call->headers = headers;
+
+  dthread_mutex_lock(&m_lock);
+  m_refs++;
+  m_started++;
+  dthread_mutex_unlock(&m_lock);
+
+  pthread_t thread;
+  if (dthread_create(&thread, NULL, ReplicaRequestGroup::run, call) != 0) {
+    cerr << "could not start replica request to " << peer << endl;
+    ReplicaResponse failed;
+    failed.peer = peer;
+    failed.status = 0;
+    delete call;
+    finish(failed);
+    return;
+  }
+  dthread_detach(thread);
+}
+
+void *ReplicaRequestGroup::run(void *arg) {
+  struct Call *call = (struct Call *) arg;
+
+  ReplicaResponse response;
+  response.peer = call->peer;
+  response.status = 0;
+
+  string host;
+  int port;
+  if (ReplicaSet::parsePeer(call->peer, &host, &port)) {
+    HttpClient *client = NULL;
+    try {
+      client = new HttpClient(host.c_str(), port);
+      if (call->group->track(client)) {
+	map<string, string>::iterator iter;
+	for (iter = call->headers.begin(); iter != call->headers.end(); iter++) {
+	  client->set_header(iter->first, iter->second);
+	}
+	client->write_request(call->path, call->method, call->body);
+	HTTPClientResponse *clientResponse = client->read_response();
+	response.status = clientResponse->status();
+	response.body = clientResponse->body();
+	response.version = clientResponse->header(VERSION_HEADER);
+	delete clientResponse;
+      }
+    } catch (...) {
+      // unreachable peers are reported with a zero status
+      response.status = 0;
+    }
+    if (client != NULL) {
+      call->group->untrack(client);
+      delete client;
+    }
+  }
+
+  ReplicaRequestGroup *group = call->group;
+  delete call;
+  group->finish(response);
+  return NULL;
+}
+
+// remember a connected client so that cancel() can reach it, returns
+// false if the group was cancelled before the request went out
+bool ReplicaRequestGroup::track(HttpClient *client) {
+  dthread_mutex_lock(&m_lock);
+  bool cancelled = m_cancelled;
+  if (!cancelled) {
+    m_clients.push_back(client);
+  }
+  dthread_mutex_unlock(&m_lock);
+  return !cancelled;
+}
+
+void ReplicaRequestGroup::untrack(HttpClient *client) {
+  dthread_mutex_lock(&m_lock);
+  for (size_t idx = 0; idx < m_clients.size(); idx++) {
+    if (m_clients[idx] == client) {
+      m_clients.erase(m_clients.begin() + idx);
+      break;
+    }
+  }
+  dthread_mutex_unlock(&m_lock);
+}
+
+void ReplicaRequestGroup::cancel() {
+  dthread_mutex_lock(&m_lock);
+  m_cancelled = true;
+  for (size_t idx = 0; idx < m_clients.size(); idx++) {
+    m_clients[idx]->cancel();
+  }
+  dthread_mutex_unlock(&m_lock);
+}
+
+void ReplicaRequestGroup::finish(ReplicaResponse response) {
+  dthread_mutex_lock(&m_lock);
+  m_finished++;
+  if (response.status != 0 && !m_cancelled) {
+    m_responses.push_back(response);
+  }
+  if (response.status >= 200 && response.status < 300 && !m_cancelled) {
+    m_succeeded++;
+  }
+  if (response.status != 0 && response.status < 500 && !m_cancelled) {
+    m_usable++;
+  }
+  dthread_cond_broadcast(&m_answered);
+  dthread_mutex_unlock(&m_lock);
+
+  unref();
+}
+
+bool ReplicaRequestGroup::waitFor(int needed, bool successOnly, int timeoutMs) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeoutMs / 1000;
+  deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  dthread_mutex_lock(&m_lock);
+  while (true) {
+    int answers = successOnly ? m_succeeded : m_usable;
+    if (answers >= needed || m_finished == m_started) {
+      break;
+    }
+    if (dthread_cond_timedwait(&m_answered, &m_lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  int answers = successOnly ? m_succeeded : m_usable;
+  dthread_mutex_unlock(&m_lock);
+
+  return answers >= needed;
+}
+
+vector<ReplicaResponse> ReplicaRequestGroup::responses() {
+  dthread_mutex_lock(&m_lock);
+  vector<ReplicaResponse> result = m_responses;
+  dthread_mutex_unlock(&m_lock);
+  return result;
+}
+
+void ReplicaRequestGroup::release() {
+  unref();
+}
+
+void ReplicaRequestGroup::unref() {
+  dthread_mutex_lock(&m_lock);
+  m_refs--;
+  bool last = (m_refs == 0);
+  dthread_mutex_unlock(&m_lock);
+
+  if (last) {
+    delete this;
+  }
+}
+
+
+ReplicaSet::ReplicaSet(vector<string> peers, int timeoutMs) {
+  this->m_peers = peers;
+  this->m_timeoutMs = timeoutMs;
+}
+
+vector<ReplicaResponse> ReplicaSet::fanOut(string method, string path, string body,
+					   map<string, string> headers,
+					   int needed, bool successOnly) {
+  // every peer gets the request even when we do not wait for it, so
+  // writes at a low consistency level still reach all replicas
+  ReplicaRequestGroup *group = new ReplicaRequestGroup();
+  for (size_t idx = 0; idx < m_peers.size(); idx++) {
+    group->start(m_peers[idx], method, path, body, headers);
+  }
+  if (needed > 0) {
+    group->waitFor(needed, successOnly, m_timeoutMs);
+  }
+  vector<ReplicaResponse> result = group->responses();
+  group->release();
+
+  return result;
+}
+
+void ReplicaSet::sendAsync(string peer, string method, string path,
+			   string body, map<string, string> headers) {
+  ReplicaRequestGroup *group = new ReplicaRequestGroup();
+  group->start(peer, method, path, body, headers);
+  group->release();
+}
+
+bool ReplicaSet::parsePeer(string peer, string *host, int *port) {
+  size_t colon = peer.rfind(':');
+  if (colon == string::npos || colon == 0) {
+    return false;
+  }
+  *host = peer.substr(0, colon);
+  *port = atoi(peer.substr(colon + 1).c_str());
+  return *port > 0;
+}
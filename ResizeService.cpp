@@ -0,0 +1,70 @@
+#include <stdlib.h>
+
+#include <sstream>
+#include <string>
+
+#include "ResizeService.h"
+#include "ClientError.h"
+#include "FileSystemLock.h"
+
+using namespace std;
+
+ResizeService::ResizeService(DistributedFileSystemService *ds3) : HttpService("/ds3-resize/") {
+  m_ds3 = ds3;
+}
+
+void ResizeService::get(HTTPRequest *request, HTTPResponse *response) {
+  if (request->getPath() != pathPrefix()) {
+    throw ClientError::notFound();
+  }
+
+  super_t super;
+  {
+    FileSystemLock guard(m_ds3->fileSystemLock());
+    m_ds3->localFileSystem()->readSuperBlock(&super);
+  }
+
+  stringstream body;
+  body << super.num_inodes << "\t" << super.num_data << "\n";
+  response->setBody(body.str());
+}
+
+void ResizeService::post(HTTPRequest *request, HTTPResponse *response) {
+  if (request->getPath() != pathPrefix()) {
+    throw ClientError::badRequest();
+  }
+
+  string inodes;
+  string data;
+  try {
+    WwwFormEncodedDict form = request->formEncodedBody();
+    inodes = form.get("inodes");
+    data = form.get("data");
+  } catch (...) {
+    throw ClientError::badRequest();
+  }
+
+  LocalFileSystem *fileSystem = m_ds3->localFileSystem();
+  FileSystemLock guard(m_ds3->fileSystemLock());
+  super_t super;
+  fileSystem->readSuperBlock(&super);
+  // sizes past an int would wrap, resize then rejects anything too large
+  long long numInodes = (inodes == "") ? super.num_inodes : atoll(inodes.c_str());
+  long long numData = (data == "") ? super.num_data : atoll(data.c_str());
+  if (numInodes < 0 || numData < 0 || numInodes > RESIZE_MAX_INODES || numData > RESIZE_MAX_DATA_BLOCKS) {
+    throw ClientError::badRequest();
+  }
+
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+  int moved = fileSystem->resize(numInodes, numData);
+  if (moved < 0) {
+    disk->rollback();
+    throw ClientError::badRequest(); // images only grow, up to the limits
+  }
+  disk->commit();
+
+  stringstream body;
+  body << numInodes << "\t" << numData << "\n";
+  response->setBody(body.str());
+}
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SnapshotService.h"
+#include "ClientError.h"
+#include "FileSystemLock.h"
+#include "StringUtils.h"
+
+using namespace std;
+
+SnapshotService::SnapshotService(DistributedFileSystemService *ds3) : HttpService("/ds3-snap/") {
+  m_ds3 = ds3;
+}
+
+void SnapshotService::get(HTTPRequest *request, HTTPResponse *response) {
+  string path = request->getPath().substr(pathPrefix().size());
+  vector<string> tokens = StringUtils::split(path, '/');
+  LocalFileSystem *fileSystem = m_ds3->localFileSystem();
+  FileSystemLock guard(m_ds3->fileSystemLock());
+
+  if (tokens.empty()) {
+    stringstream listing;
+    vector<snapshot_ent_t> snapshots = fileSystem->snapshots();
+    for (size_t idx = 0; idx < snapshots.size(); idx++) {
+      listing << snapshots[idx].id << "\t" << snapshots[idx].created << "\n";
+    }
+    response->setBody(listing.str());
+    return;
+  }
+
+  LocalFileSystem *view = fileSystem->openSnapshot(snapshotId(tokens[0]));
+  if (view == NULL) {
+    throw ClientError::notFound();
+  }
+
+  // the rest of the path, with the trailing slash that marks directories
+  size_t rest = path.find('/', path.find(tokens[0]));
+  path = (rest == string::npos) ? "" : path.substr(rest);
+
+  try {
+    bool isDirectory;
+    string body = DistributedFileSystemService::readPath(view, path, &isDirectory);
+    delete view;
+    response->setBody(body);
+  } catch (...) {
+    delete view;
+    throw;
+  }
+}
+
+void SnapshotService::post(HTTPRequest *request, HTTPResponse *response) {
+  if (request->getPath() != pathPrefix()) {
+    throw ClientError::badRequest();
+  }
+
+  LocalFileSystem *fileSystem = m_ds3->localFileSystem();
+  FileSystemLock guard(m_ds3->fileSystemLock());
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+  int id = fileSystem->snapshot();
+  if (id < 0) {
+    disk->rollback();
+    if (id == -ENOTSUPPORTED) {
+      throw ClientError::notImplemented(); // made by an older mkfs
+    }
+    throw ClientError::insufficientStorage();
+  }
+  disk->commit();
+
+  stringstream body;
+  body << id << "\n";
+  response->setBody(body.str());
+}
+
+void SnapshotService::del(HTTPRequest *request, HTTPResponse *response) {
+  vector<string> tokens = StringUtils::split(request->getPath().substr(pathPrefix().size()), '/');
+  if (tokens.size() != 1) {
+    throw ClientError::badRequest();
+  }
+  int id = snapshotId(tokens[0]);
+
+  LocalFileSystem *fileSystem = m_ds3->localFileSystem();
+  FileSystemLock guard(m_ds3->fileSystemLock());
+  Disk *disk = fileSystem->disk;
+  disk->beginTransaction();
+  if (fileSystem->deleteSnapshot(id) < 0) {
+    disk->rollback();
+    throw ClientError::notFound();
+  }
+  disk->commit();
+  response->setStatus(200);
+}
+
+int SnapshotService::snapshotId(string component) {
+  char *end;
+  long id = strtol(component.c_str(), &end, 10);
+  if (*end != '\0' || id <= 0) {
+    throw ClientError::notFound();
+  }
+  return id;
+}
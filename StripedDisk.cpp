@@ -0,0 +1,193 @@
+#include <iostream>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+
+#include <sys/stat.h>
+
+#include "StripedDisk.h"
+#include "dthread.h"
+
+using namespace std;
+
+// the parts together, in bytes
+static off_t imageSize(const vector<string> &partFiles) {
+  off_t size = 0;
+  for (size_t i = 0; i < partFiles.size(); i++) {
+    struct stat stat;
+    if (::stat(partFiles[i].c_str(), &stat) != 0) {
+      cerr << "could not open " << partFiles[i] << endl;
+      exit(1);
+    }
+    size += stat.st_size;
+  }
+  return size;
+}
+
+static string joined(const vector<string> &partFiles) {
+  string result;
+  for (size_t i = 0; i < partFiles.size(); i++) {
+    result += (i > 0 ? "," : "") + partFiles[i];
+  }
+  return result;
+}
+
+StripedDisk::StripedDisk(vector<string> partFiles, int blockSize, int stripeBlocks)
+  : Disk(joined(partFiles), blockSize, imageSize(partFiles)) {
+  this->partFiles = partFiles;
+  this->stripeBlocks = stripeBlocks;
+  if (partFiles.empty() || stripeBlocks <= 0) {
+    cerr << "A striped image needs at least one part and a positive stripe size" << endl;
+    exit(1);
+  }
+
+  int parts = partFiles.size();
+  for (int i = 0; i < parts; i++) {
+    int fd = open(partFiles[i].c_str(), O_RDWR);
+    if (fd < 0) {
+      cerr << "could not open " << partFiles[i] << endl;
+      exit(1);
+    }
+    fds.push_back(fd);
+  }
+
+  // a part of the wrong size was striped differently, or isn't a part
+  for (int i = 0; i < parts; i++) {
+    off_t expected = (off_t) partBlocks(i, parts, stripeBlocks, numberOfBlocks()) * blockSize;
+    off_t size = lseek(fds[i], 0, SEEK_END);
+    if (size != expected) {
+      cerr << "Part " << partFiles[i] << " is " << size << " bytes, a stripe of "
+	   << stripeBlocks << " blocks over " << parts << " parts needs " << expected << endl;
+      exit(1);
+    }
+  }
+}
+
+StripedDisk::~StripedDisk() {
+  for (size_t i = 0; i < fds.size(); i++) {
+    close(fds[i]);
+  }
+}
+
+int StripedDisk::partBlocks(int part, int parts, int stripeBlocks, int imageBlocks) {
+  int units = imageBlocks / stripeBlocks;
+  int blocks = (units / parts) * stripeBlocks;
+  if (part < units % parts) {
+    blocks += stripeBlocks;
+  } else if (part == units % parts) {
+    blocks += imageBlocks % stripeBlocks;
+  }
+  return blocks;
+}
+
+int StripedDisk::partOf(int blockNumber) {
+  return (blockNumber / stripeBlocks) % fds.size();
+}
+
+int StripedDisk::partBlock(int blockNumber) {
+  int unit = blockNumber / stripeBlocks;
+  return (unit / fds.size()) * stripeBlocks + blockNumber % stripeBlocks;
+}
+
+void StripedDisk::readRaw(int blockNumber, void *buffer) {
+  off_t offset = (off_t) partBlock(blockNumber) * blockSize;
+  if (pread(fds[partOf(blockNumber)], buffer, blockSize, offset) != blockSize) {
+    cerr << "Could not read file" << endl;
+    exit(1);
+  }
+}
+
+void StripedDisk::writeRaw(int blockNumber, const void *buffer) {
+  off_t offset = (off_t) partBlock(blockNumber) * blockSize;
+  if (pwrite(fds[partOf(blockNumber)], buffer, blockSize, offset) != blockSize) {
+    cerr << "Could not write file" << endl;
+    exit(1);
+  }
+}
+
+void StripedDisk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  transfer(false, blockNumbers, buffer);
+}
+
+void StripedDisk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  transfer(true, blockNumbers, (unsigned char *) buffer);
+}
+
+// Split the batch by part and move every share at once, this thread
+// taking the last one.
+void StripedDisk::transfer(bool write, const vector<int> &blockNumbers, unsigned char *buffer) {
+  vector<struct PartTransfer> shares(fds.size());
+  vector<int> busy;
+  for (size_t i = 0; i < blockNumbers.size(); i++) {
+    int part = partOf(blockNumbers[i]);
+    if (shares[part].blocks.empty()) {
+      busy.push_back(part);
+    }
+    shares[part].blocks.push_back(make_pair((int) i, partBlock(blockNumbers[i])));
+  }
+  if (busy.empty()) {
+    return;
+  }
+
+  vector<pthread_t> threads(busy.size() - 1);
+  for (size_t i = 0; i < busy.size(); i++) {
+    struct PartTransfer *share = &shares[busy[i]];
+    share->disk = this;
+    share->part = busy[i];
+    share->write = write;
+    share->buffer = buffer;
+    if (i < threads.size()) {
+      dthread_create(&threads[i], NULL, transferPart, share);
+    } else {
+      transferPart(share);
+    }
+  }
+  for (size_t i = 0; i < threads.size(); i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+// blocks adjacent both in the part and in the buffer go in one call
+void *StripedDisk::transferPart(void *arg) {
+  struct PartTransfer *share = (struct PartTransfer *) arg;
+  int blockSize = share->disk->blockSize;
+  int fd = share->disk->fds[share->part];
+  size_t first = 0;
+  while (first < share->blocks.size()) {
+    size_t end = first + 1;
+    while (end < share->blocks.size() &&
+	   share->blocks[end].first == share->blocks[end - 1].first + 1 &&
+	   share->blocks[end].second == share->blocks[end - 1].second + 1) {
+      end++;
+    }
+    unsigned char *memory = share->buffer + (size_t) share->blocks[first].first * blockSize;
+    ssize_t length = (ssize_t) (end - first) * blockSize;
+    off_t offset = (off_t) share->blocks[first].second * blockSize;
+    ssize_t ret = share->write ? pwrite(fd, memory, length, offset) : pread(fd, memory, length, offset);
+    if (ret != length) {
+      cerr << (share->write ? "Could not write file" : "Could not read file") << endl;
+      exit(1);
+    }
+    first = end;
+  }
+  return NULL;
+}
+
+void StripedDisk::sync() {
+  for (size_t i = 0; i < fds.size(); i++) {
+    fsync(fds[i]);
+  }
+}
+
+void StripedDisk::extend(off_t size) {
+  int imageBlocks = size / blockSize;
+  for (size_t i = 0; i < fds.size(); i++) {
+    off_t partSize = (off_t) partBlocks(i, fds.size(), stripeBlocks, imageBlocks) * blockSize;
+    if (ftruncate(fds[i], partSize) != 0) {
+      perror("grow::ftruncate");
+      cerr << "Could not grow image file " << partFiles[i] << endl;
+      exit(1);
+    }
+  }
+}
@@ -0,0 +1,173 @@
+#include <errno.h>
+#include <iostream>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "UringDisk.h"
+
+using namespace std;
+
+UringDisk::UringDisk(string imageFile, int blockSize) : Disk(imageFile, blockSize) {
+  this->fd = open(imageFile.c_str(), O_RDWR);
+  if (this->fd < 0) {
+    cerr << "could not open " << imageFile << endl;
+    exit(1);
+  }
+  this->sqRing = MAP_FAILED;
+  this->cqRing = MAP_FAILED;
+  this->sqes = (struct io_uring_sqe *) MAP_FAILED;
+  if (!setupRing()) {
+    cerr << "io_uring is not available, reading blocks one at a time" << endl;
+  }
+}
+
+UringDisk::~UringDisk() {
+  if (ringFd >= 0) {
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing) {
+      munmap(cqRing, cqRingSize);
+    }
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+  }
+  close(fd);
+}
+
+// map the rings the way io_uring_setup(2) describes
+bool UringDisk::setupRing() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ringFd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+  if (ringFd < 0) {
+    return false;
+  }
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+  }
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ringFd, IORING_OFF_SQ_RING);
+  cqRing = singleMmap ? sqRing :
+    mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+  sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe *) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				      ringFd, IORING_OFF_SQES);
+  if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("mmap");
+    cerr << "Could not map the io_uring rings" << endl;
+    exit(1);
+  }
+
+  unsigned char *sq = (unsigned char *) sqRing;
+  sqTail = (unsigned *) (sq + params.sq_off.tail);
+  sqMask = *(unsigned *) (sq + params.sq_off.ring_mask);
+  sqEntries = params.sq_entries;
+  sqArray = (unsigned *) (sq + params.sq_off.array);
+  unsigned char *cq = (unsigned char *) cqRing;
+  cqHead = (unsigned *) (cq + params.cq_off.head);
+  cqTail = (unsigned *) (cq + params.cq_off.tail);
+  cqMask = *(unsigned *) (cq + params.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+  return true;
+}
+
+int UringDisk::enter(unsigned toSubmit, unsigned minComplete) {
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    perror("io_uring_enter");
+    cerr << "Could not read file" << endl;
+    exit(1);
+  }
+  return ret;
+}
+
+void UringDisk::readRawBlocks(const vector<int> &blockNumbers, unsigned char *buffer) {
+  if (ringFd < 0) {
+    Disk::readRawBlocks(blockNumbers, buffer);
+    return;
+  }
+
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  size_t done = 0;
+  while (done < batchRuns.size()) {
+    unsigned batch = min(batchRuns.size() - done, (size_t) sqEntries);
+
+    // only this thread moves the tail, the kernel reads it
+    unsigned tail = *sqTail;
+    for (unsigned i = 0; i < batch; i++) {
+      pair<int, int> run = batchRuns[done + i];
+      unsigned index = tail & sqMask;
+      struct io_uring_sqe *sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = (unsigned long) (buffer + (size_t) run.first * blockSize);
+      sqe->len = run.second * blockSize;
+      sqe->off = (off_t) blockNumbers[run.first] * blockSize;
+      // the length, to check the completion against
+      sqe->user_data = run.second * blockSize;
+      sqArray[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    int submitted = enter(batch, batch);
+    for (int reaped = 0; reaped < submitted; ) {
+      unsigned head = *cqHead;
+      if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+	enter(0, 1);
+	continue;
+      }
+      struct io_uring_cqe *cqe = &cqes[head & cqMask];
+      if (cqe->res < 0 || (unsigned long long) cqe->res != cqe->user_data) {
+	cerr << "Could not read file" << endl;
+	exit(1);
+      }
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+      reaped++;
+    }
+    done += submitted;
+  }
+}
+
+void UringDisk::writeRawBlocks(const vector<int> &blockNumbers, const unsigned char *buffer) {
+  vector<pair<int, int> > batchRuns = runs(blockNumbers);
+  for (size_t i = 0; i < batchRuns.size(); i++) {
+    ssize_t length = (ssize_t) batchRuns[i].second * blockSize;
+    off_t offset = (off_t) blockNumbers[batchRuns[i].first] * blockSize;
+    if (pwrite(fd, buffer + (size_t) batchRuns[i].first * blockSize, length, offset) != length) {
+      cerr << "Could not write file" << endl;
+      exit(1);
+    }
+  }
+}
+
+void UringDisk::readRaw(int blockNumber, void *buffer) {
+  if (pread(fd, buffer, blockSize, (off_t) blockNumber * blockSize) != blockSize) {
+    cerr << "Could not read file" << endl;
+    exit(1);
+  }
+}
+
+void UringDisk::writeRaw(int blockNumber, const void *buffer) {
+  if (pwrite(fd, buffer, blockSize, (off_t) blockNumber * blockSize) != blockSize) {
+    cerr << "Could not write file" << endl;
+    exit(1);
+  }
+}
+
+void UringDisk::sync() {
+  fsync(fd);
+}
@@ -0,0 +1,105 @@
+#include <sstream>
+#include <stdlib.h>
+
+#include "VersionVector.h"
+#include "StringUtils.h"
+
+using namespace std;
+
+VersionVector::VersionVector() {
+}
+
+VersionVector VersionVector::parse(string encoded) {
+  VersionVector result;
+  vector<string> entries = StringUtils::split(encoded, ',');
+  for (size_t idx = 0; idx < entries.size(); idx++) {
+    size_t equals = entries[idx].find('=');
+    if (equals == string::npos || equals == 0) {
+      continue;
+    }
+    string node = entries[idx].substr(0, equals);
+    unsigned long counter = strtoul(entries[idx].substr(equals + 1).c_str(), NULL, 10);
+    if (counter > 0) {
+      result.m_counters[node] = counter;
+    }
+  }
+  return result;
+}
+
+string VersionVector::toString() const {
+  stringstream out;
+  map<string, unsigned long>::const_iterator iter;
+  for (iter = m_counters.begin(); iter != m_counters.end(); iter++) {
+    if (iter != m_counters.begin()) {
+      out << ",";
+    }
+    out << iter->first << "=" << iter->second;
+  }
+  return out.str();
+}
+
+void VersionVector::increment(string nodeId) {
+  m_counters[nodeId] += 1;
+}
+
+void VersionVector::merge(const VersionVector &other) {
+  map<string, unsigned long>::const_iterator iter;
+  for (iter = other.m_counters.begin(); iter != other.m_counters.end(); iter++) {
+    if (m_counters[iter->first] < iter->second) {
+      m_counters[iter->first] = iter->second;
+    }
+  }
+}
+
+VersionVector::Ordering VersionVector::compare(const VersionVector &other) const {
+  bool someLess = false;
+  bool someGreater = false;
+
+  map<string, unsigned long>::const_iterator iter;
+  for (iter = m_counters.begin(); iter != m_counters.end(); iter++) {
+    map<string, unsigned long>::const_iterator theirs = other.m_counters.find(iter->first);
+    unsigned long theirCounter = (theirs == other.m_counters.end()) ? 0 : theirs->second;
+    if (iter->second < theirCounter) {
+      someLess = true;
+    } else if (iter->second > theirCounter) {
+      someGreater = true;
+    }
+  }
+  for (iter = other.m_counters.begin(); iter != other.m_counters.end(); iter++) {
+    if (m_counters.find(iter->first) == m_counters.end() && iter->second > 0) {
+      someLess = true;
+    }
+  }
+
+  if (someLess && someGreater) {
+    return CONCURRENT;
+  } else if (someLess) {
+    return BEFORE;
+  } else if (someGreater) {
+    return AFTER;
+  }
+  return EQUAL;
+}
+
+bool VersionVector::newerThan(const VersionVector &other) const {
+  Ordering ordering = compare(other);
+  if (ordering != CONCURRENT) {
+    return ordering == AFTER;
+  }
+
+  // concurrent writes: the copy that has seen more updates wins, and the
+  // encoded form breaks any remaining tie
+  if (total() != other.total()) {
+    return total() > other.total();
+  }
+  return toString() > other.toString();
+}
+
+unsigned long VersionVector::total() const {
+  unsigned long sum = 0;
+  map<string, unsigned long>::const_iterator iter;
+  for (iter = m_counters.begin(); iter != m_counters.end(); iter++) {
+    sum += iter->second;
+  }
+  return sum;
+}
@@ -51,6 +51,37 @@ int main(int argc, char *argv[]) {
   }
   cout << endl;
 
+  // blocks with extra references are shared by copies or by deduplication
+  if (super.refcount_addr != 0) {
+    refcount_t *refcounts = new refcount_t[super.refcount_len * UFS_BLOCK_SIZE / sizeof(refcount_t)];
+    fileSystem->readRefcounts(&super, refcounts);
+    long long physical = 0;
+    long long logical = 0;
+    for (int i = 0; i < super.num_data; i++) {
+      if (dataBitmap[i / 8] & (1 << (i % 8))) {
+	physical++;
+	logical += 1 + refcounts[i];
+      }
+    }
+    cout << endl << "Sharing" << endl;
+    cout << "logical_blocks " << logical << endl;
+    cout << "physical_blocks " << physical << endl;
+    if (physical > 0) {
+      cout << "ratio " << (double) logical / physical << endl;
+    }
+    delete[] refcounts;
+  }
+
+  // read every block once so the checksum table checks all of them
+  if (super.checksum_addr != 0) {
+    unsigned char block[UFS_BLOCK_SIZE];
+    for (int i = 0; i < disk->numberOfBlocks(); i++) {
+      disk->readBlock(i, block);
+    }
+    cout << endl << "Checksums" << endl;
+    cout << "mismatches " << disk->checksumMismatches() << endl;
+  }
+
   // clean up allocated memory
   delete[] inodeBitmap;
   delete[] dataBitmap;
@@ -44,10 +44,8 @@ int main(int argc, char *argv[]) {
   }
 
   // print out file blocks
-  int blocks = inode.size / UFS_BLOCK_SIZE;
-  if ((inode.size % UFS_BLOCK_SIZE) != 0) {
-    blocks += 1;
-  }
+  // compressed files use fewer blocks than their size needs
+  int blocks = fileSystem->storedBlocks(inodeNumber);
 
   cout << "File blocks" << endl;
   for (int i = 0; i < blocks; ++i) {
@@ -0,0 +1,669 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Crc32c.h"
+#include "LocalFileSystem.h"
+#include "Disk.h"
+#include "dthread.h"
+#include "ufs.h"
+
+using namespace std;
+
+// exit codes, as fsck(8) uses them
+#define FSCK_OK (0)
+#define FSCK_CORRECTED (1)
+#define FSCK_UNCORRECTED (4)
+#define FSCK_USAGE (16)
+
+struct BadEntry {
+  int directory;
+  string name;
+};
+
+Disk *disk;
+LocalFileSystem *fileSystem;
+super_t super;
+int threads = 4;
+
+// the image, for reads that the walkers make in parallel
+int imageFd;
+
+vector<inode_t> inodes;
+vector<unsigned char> inodeBitmap;
+vector<unsigned char> dataBitmap;
+vector<refcount_t> refcounts;
+
+// directories waiting for a walker, with the parent they were found in
+pthread_mutex_t walkLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t walkChanged = PTHREAD_COND_INITIALIZER;
+deque<pair<int, int> > pendingDirectories;
+int activeWalkers;
+
+// what the walk found, guarded by walkLock
+vector<int> parentOf;          // -1 until the directory is reached
+vector<int> links;             // entries naming each inode
+vector<string> problems;
+vector<BadEntry> badEntries;   // entries to drop
+vector<pair<int, int> > wrongParents;  // directories whose ".." should name the parent
+vector<int> badInodes;         // reachable inodes with bad contents
+
+// what the inodes and snapshots use, rebuilt by every check
+vector<bool> inodeUsed;
+vector<int> blockUses;
+
+
+void problem(string description) {
+  dthread_mutex_lock(&walkLock);
+  problems.push_back(description);
+  dthread_mutex_unlock(&walkLock);
+}
+
+void readImageBlock(int blockNumber, void *buffer) {
+  if (pread(imageFd, buffer, UFS_BLOCK_SIZE, (off_t) blockNumber * UFS_BLOCK_SIZE) != UFS_BLOCK_SIZE) {
+    cerr << "Could not read block " << blockNumber << endl;
+    exit(FSCK_UNCORRECTED);
+  }
+}
+
+bool isAllocated(const vector<unsigned char> &bitmap, int index) {
+  return bitmap[index / 8] & (1 << (index % 8));
+}
+
+bool inDataRegion(unsigned int blockNumber) {
+  return blockNumber >= (unsigned int) super.data_region_addr &&
+    blockNumber < (unsigned int) (super.data_region_addr + super.num_data);
+}
+
+// what is wrong with an inode, "" when nothing is
+string inodeError(const inode_t &inode) {
+  int type = inode.type & UFS_TYPE_MASK;
+  int flags = inode.type & ~UFS_TYPE_MASK;
+  if (type != UFS_DIRECTORY && type != UFS_REGULAR_FILE) {
+    return "has an unknown type";
+  }
+  if ((flags & ~(UFS_FLAG_COMPRESSED | UFS_FLAG_INLINE)) != 0 ||
+      (flags == (UFS_FLAG_COMPRESSED | UFS_FLAG_INLINE))) {
+    return "has unknown flags";
+  }
+  if (inode.size < 0 || inode.size > MAX_FILE_SIZE ||
+      ((flags & UFS_FLAG_INLINE) && inode.size > (int) UFS_INLINE_SIZE)) {
+    return "has an invalid size";
+  }
+  if ((flags & UFS_FLAG_COMPRESSED) &&
+      (type != UFS_REGULAR_FILE || inode.direct[DIRECT_PTRS - 1] == 0 ||
+       inode.direct[DIRECT_PTRS - 1] > (DIRECT_PTRS - 1) * UFS_BLOCK_SIZE)) {
+    return "has an invalid compressed length";
+  }
+  if (type == UFS_DIRECTORY &&
+      (inode.size % sizeof(dir_ent_t) != 0 || inode.size < (int) (2 * sizeof(dir_ent_t)))) {
+    return "is a directory of invalid size";
+  }
+  for (int i = 0; i < LocalFileSystem::blocksOf(&inode); i++) {
+    if (!inDataRegion(inode.direct[i])) {
+      return "points outside the data region";
+    }
+  }
+  return "";
+}
+
+// the entries of a directory whose inode passed inodeError
+vector<dir_ent_t> readEntries(const inode_t &inode) {
+  vector<dir_ent_t> entries(inode.size / sizeof(dir_ent_t));
+  if (inode.type & UFS_FLAG_INLINE) {
+    memcpy(entries.data(), inode.direct, inode.size);
+    return entries;
+  }
+  unsigned char block[UFS_BLOCK_SIZE];
+  for (int i = 0; i < LocalFileSystem::blocksOf(&inode); i++) {
+    readImageBlock(inode.direct[i], block);
+    int bytes = min(UFS_BLOCK_SIZE, inode.size - i * UFS_BLOCK_SIZE);
+    memcpy(((unsigned char *) entries.data()) + i * UFS_BLOCK_SIZE, block, bytes);
+  }
+  return entries;
+}
+
+string entryName(const dir_ent_t &entry) {
+  return string(entry.name, strnlen(entry.name, DIR_ENT_NAME_SIZE));
+}
+
+void checkDirectory(int directory, int parent) {
+  const inode_t &inode = inodes[directory];
+  vector<dir_ent_t> entries = readEntries(inode);
+
+  stringstream where;
+  where << "directory " << directory << ": ";
+  if (entryName(entries[0]) != "." || entries[0].inum != directory) {
+    problem(where.str() + "\".\" doesn't name the directory");
+    dthread_mutex_lock(&walkLock);
+    wrongParents.push_back(make_pair(directory, parent));
+    dthread_mutex_unlock(&walkLock);
+  }
+  if (entryName(entries[1]) != ".." || entries[1].inum != parent) {
+    problem(where.str() + "\"..\" doesn't name its parent");
+    dthread_mutex_lock(&walkLock);
+    wrongParents.push_back(make_pair(directory, parent));
+    dthread_mutex_unlock(&walkLock);
+  }
+
+  for (size_t i = 2; i < entries.size(); i++) {
+    string name = entryName(entries[i]);
+    int child = entries[i].inum;
+    BadEntry bad = {directory, name};
+
+    if (name == "" || name == "." || name == "..") {
+      problem(where.str() + "entry \"" + name + "\" has a reserved name");
+      dthread_mutex_lock(&walkLock);
+      badEntries.push_back(bad);
+      dthread_mutex_unlock(&walkLock);
+      continue;
+    }
+    if (child < 0 || child >= super.num_inodes) {
+      problem(where.str() + "entry \"" + name + "\" names an invalid inode");
+      dthread_mutex_lock(&walkLock);
+      badEntries.push_back(bad);
+      dthread_mutex_unlock(&walkLock);
+      continue;
+    }
+
+    string error = inodeError(inodes[child]);
+    stringstream about;
+    about << where.str() << "entry \"" << name << "\" names inode " << child;
+    if (!isAllocated(inodeBitmap, child) && error != "") {
+      problem(about.str() + ", which is free");
+      dthread_mutex_lock(&walkLock);
+      badEntries.push_back(bad);
+      dthread_mutex_unlock(&walkLock);
+      continue;
+    }
+    if (error != "") {
+      problem(about.str() + ", which " + error);
+      dthread_mutex_lock(&walkLock);
+      badInodes.push_back(child);
+      dthread_mutex_unlock(&walkLock);
+    }
+
+    dthread_mutex_lock(&walkLock);
+    links[child]++;
+    bool isDirectory = (inodes[child].type & UFS_TYPE_MASK) == UFS_DIRECTORY;
+    bool walk = false;
+    if (isDirectory && parentOf[child] != -1) {
+      badEntries.push_back(bad);
+    } else if (isDirectory) {
+      parentOf[child] = directory;
+      walk = error == "";
+    }
+    if (walk) {
+      pendingDirectories.push_back(make_pair(child, directory));
+      dthread_cond_signal(&walkChanged);
+    }
+    dthread_mutex_unlock(&walkLock);
+    if (isDirectory && !walk && error == "") {
+      problem(about.str() + ", a directory that already has a parent");
+    }
+  }
+}
+
+void *walker(void *arg) {
+  dthread_mutex_lock(&walkLock);
+  while (true) {
+    while (pendingDirectories.empty() && activeWalkers > 0) {
+      dthread_cond_wait(&walkChanged, &walkLock);
+    }
+    if (pendingDirectories.empty()) {
+      break;
+    }
+    pair<int, int> next = pendingDirectories.front();
+    pendingDirectories.pop_front();
+    activeWalkers++;
+    dthread_mutex_unlock(&walkLock);
+
+    checkDirectory(next.first, next.second);
+
+    dthread_mutex_lock(&walkLock);
+    activeWalkers--;
+    if (pendingDirectories.empty() && activeWalkers == 0) {
+      dthread_cond_broadcast(&walkChanged);
+    }
+  }
+  dthread_mutex_unlock(&walkLock);
+  return NULL;
+}
+
+// the regions must lie inside the image without overlapping
+bool checkSuperBlock() {
+  int blocks = disk->numberOfBlocks();
+  int inodesPerBlock = UFS_BLOCK_SIZE / sizeof(inode_t);
+  int bitsPerBlock = 8 * UFS_BLOCK_SIZE;
+  bool valid = super.num_inodes > 0 && super.num_data > 0 &&
+    super.inode_bitmap_len * bitsPerBlock >= super.num_inodes &&
+    super.data_bitmap_len * bitsPerBlock >= super.num_data &&
+    super.inode_region_len * inodesPerBlock >= super.num_inodes &&
+    super.data_region_len == super.num_data &&
+    super.inode_init_len >= 0 && super.inode_init_len <= super.inode_region_len &&
+    (super.refcount_addr == 0 ||
+     super.refcount_len * (int) (UFS_BLOCK_SIZE / sizeof(refcount_t)) >= super.num_data) &&
+    (super.fingerprint_addr == 0 || super.fingerprint_len > 0) &&
+    (super.checksum_addr == 0 ||
+     super.checksum_len * (int) (UFS_BLOCK_SIZE / sizeof(uint32_t)) >= blocks);
+
+  vector<pair<int, int> > regions;
+  regions.push_back(make_pair(0, 1));
+  regions.push_back(make_pair(super.inode_bitmap_addr, super.inode_bitmap_len));
+  regions.push_back(make_pair(super.data_bitmap_addr, super.data_bitmap_len));
+  regions.push_back(make_pair(super.inode_region_addr, super.inode_region_len));
+  regions.push_back(make_pair(super.data_region_addr, super.data_region_len));
+  if (super.refcount_addr != 0) {
+    regions.push_back(make_pair(super.refcount_addr, super.refcount_len));
+  }
+  if (super.fingerprint_addr != 0) {
+    regions.push_back(make_pair(super.fingerprint_addr, super.fingerprint_len));
+  }
+  if (super.checksum_addr != 0) {
+    regions.push_back(make_pair(super.checksum_addr, super.checksum_len));
+  }
+  sort(regions.begin(), regions.end());
+  for (size_t i = 0; i < regions.size(); i++) {
+    valid = valid && regions[i].second > 0 && regions[i].first + regions[i].second <= blocks &&
+      (i == 0 || regions[i - 1].first + regions[i - 1].second <= regions[i].first);
+  }
+  if (super.snapshot_addr != 0 && (super.refcount_addr == 0 || !inDataRegion(super.snapshot_addr))) {
+    valid = false;
+  }
+
+  if (!valid) {
+    problems.push_back("superblock: regions don't fit the image");
+  }
+  return valid;
+}
+
+// count the references of one inode's blocks
+void useBlocks(const inode_t &inode) {
+  for (int i = 0; i < LocalFileSystem::blocksOf(&inode); i++) {
+    blockUses[inode.direct[i] - super.data_region_addr]++;
+  }
+}
+
+void useMetadataBlock(int blockNumber, string what) {
+  if (!inDataRegion(blockNumber)) {
+    problems.push_back(what + " points outside the data region");
+    return;
+  }
+  blockUses[blockNumber - super.data_region_addr]++;
+}
+
+// snapshots own the blocks holding their copies and every block their inodes used
+void accountSnapshots() {
+  if (super.snapshot_addr == 0) {
+    return;
+  }
+  useMetadataBlock(super.snapshot_addr, "snapshot index");
+  snapshot_index_t index;
+  readImageBlock(super.snapshot_addr, &index);
+
+  for (int slot = 0; slot < (int) UFS_MAX_SNAPSHOTS; slot++) {
+    if (index.entries[slot].id == 0) {
+      continue;
+    }
+    stringstream what;
+    what << "snapshot " << index.entries[slot].id;
+    if (!inDataRegion(index.entries[slot].header)) {
+      problems.push_back(what.str() + ": header points outside the data region");
+      continue;
+    }
+    useMetadataBlock(index.entries[slot].header, what.str() + ": header");
+    snapshot_header_t header;
+    readImageBlock(index.entries[slot].header, &header);
+    // snapshots taken before ds3resize have the smaller tables
+    if (header.inode_bitmap_len <= 0 || header.inode_bitmap_len > super.inode_bitmap_len ||
+	header.inode_region_len <= 0 || header.inode_region_len > super.inode_region_len) {
+      problems.push_back(what.str() + ": header doesn't match the superblock");
+      continue;
+    }
+
+    int copies = header.inode_bitmap_len + header.inode_region_len;
+    vector<unsigned char> copy(copies * UFS_BLOCK_SIZE);
+    bool intact = true;
+    for (int i = 0; i < copies; i++) {
+      useMetadataBlock(header.blocks[i], what.str() + ": copy");
+      intact = intact && inDataRegion(header.blocks[i]);
+      if (intact) {
+	readImageBlock(header.blocks[i], &copy[i * UFS_BLOCK_SIZE]);
+      }
+    }
+    if (!intact) {
+      continue;
+    }
+
+    inode_t *snapshotInodes = (inode_t *) &copy[header.inode_bitmap_len * UFS_BLOCK_SIZE];
+    int frozenInodes = min(super.num_inodes, header.inode_region_len * (int) (UFS_BLOCK_SIZE / sizeof(inode_t)));
+    for (int inum = 0; inum < frozenInodes; inum++) {
+      if (!(copy[inum / 8] & (1 << (inum % 8)))) {
+	continue;
+      }
+      string error = inodeError(snapshotInodes[inum]);
+      if (error != "") {
+	stringstream about;
+	about << what.str() << ": inode " << inum << " " << error;
+	problems.push_back(about.str());
+	continue;
+      }
+      useBlocks(snapshotInodes[inum]);
+    }
+  }
+}
+
+// compare the bitmaps and refcounts with what the tree and the snapshots use
+void accountBlocks() {
+  inodeUsed.assign(super.num_inodes, false);
+  blockUses.assign(super.num_data, 0);
+
+  for (int inum = 0; inum < super.num_inodes; inum++) {
+    bool reached = inum == UFS_ROOT_DIRECTORY_INODE_NUMBER || links[inum] > 0;
+    bool valid = inodeError(inodes[inum]) == "";
+    stringstream about;
+    about << "inode " << inum;
+    if (isAllocated(inodeBitmap, inum) && !reached) {
+      problems.push_back(about.str() + " is allocated but in no directory");
+    } else if (!isAllocated(inodeBitmap, inum) && reached && valid) {
+      problems.push_back(about.str() + " is in use but marked free");
+    }
+    if (reached && valid) {
+      inodeUsed[inum] = true;
+      useBlocks(inodes[inum]);
+    }
+  }
+  accountSnapshots();
+
+  for (int dataIndex = 0; dataIndex < super.num_data; dataIndex++) {
+    stringstream about;
+    about << "block " << dataIndex + super.data_region_addr;
+    int uses = blockUses[dataIndex];
+    if (uses > 0 && !isAllocated(dataBitmap, dataIndex)) {
+      problems.push_back(about.str() + " is in use but marked free");
+    } else if (uses == 0 && isAllocated(dataBitmap, dataIndex)) {
+      problems.push_back(about.str() + " is allocated but unused");
+    }
+    if (super.refcount_addr == 0) {
+      if (uses > 1) {
+	problems.push_back(about.str() + " is shared, but the image has no refcounts");
+      }
+    } else if (refcounts[dataIndex] != min(max(uses - 1, 0), UFS_REFCOUNT_MAX)) {
+      about << " has " << refcounts[dataIndex] + 1 << " references, not " << uses;
+      problems.push_back(about.str());
+    }
+  }
+}
+
+struct ChecksumRange {
+  int first;
+  int last;
+  const vector<uint32_t> *table;
+};
+
+void *checksumVerifier(void *arg) {
+  ChecksumRange *range = (ChecksumRange *) arg;
+  unsigned char block[UFS_BLOCK_SIZE];
+  for (int i = range->first; i < range->last; i++) {
+    if (i >= super.checksum_addr && i < super.checksum_addr + super.checksum_len) {
+      continue;
+    }
+    uint32_t expected = (*range->table)[i];
+    if (expected == 0) {
+      continue;
+    }
+    readImageBlock(i, block);
+    if (Crc32c::checksum(block, UFS_BLOCK_SIZE) != expected) {
+      stringstream about;
+      about << "block " << i << " doesn't match its checksum";
+      problem(about.str());
+    }
+  }
+  return NULL;
+}
+
+// the whole image is read, so the threads split it into ranges
+void checkChecksums() {
+  if (super.checksum_addr == 0) {
+    return;
+  }
+  int entriesPerBlock = UFS_BLOCK_SIZE / sizeof(uint32_t);
+  vector<uint32_t> table(super.checksum_len * entriesPerBlock);
+  for (int i = 0; i < super.checksum_len; i++) {
+    readImageBlock(super.checksum_addr + i, &table[i * entriesPerBlock]);
+  }
+
+  int blocks = disk->numberOfBlocks();
+  vector<ChecksumRange> ranges(threads);
+  vector<pthread_t> verifiers(threads);
+  for (int i = 0; i < threads; i++) {
+    ranges[i].first = (long long) blocks * i / threads;
+    ranges[i].last = (long long) blocks * (i + 1) / threads;
+    ranges[i].table = &table;
+    dthread_create(&verifiers[i], NULL, checksumVerifier, &ranges[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(verifiers[i], NULL);
+  }
+}
+
+// run every check against the image as it is on disk now
+bool check() {
+  problems.clear();
+  badEntries.clear();
+  wrongParents.clear();
+  badInodes.clear();
+
+  fileSystem->readSuperBlock(&super);
+  if (!checkSuperBlock()) {
+    return false;
+  }
+
+  inodeBitmap.assign(super.inode_bitmap_len * UFS_BLOCK_SIZE, 0);
+  fileSystem->readInodeBitmap(&super, inodeBitmap.data());
+  dataBitmap.assign(super.data_bitmap_len * UFS_BLOCK_SIZE, 0);
+  fileSystem->readDataBitmap(&super, dataBitmap.data());
+  inodes.assign(super.inode_region_len * (UFS_BLOCK_SIZE / sizeof(inode_t)), inode_t());
+  fileSystem->readInodeRegion(&super, inodes.data());
+  if (super.refcount_addr != 0) {
+    refcounts.assign(super.refcount_len * (UFS_BLOCK_SIZE / sizeof(refcount_t)), 0);
+    fileSystem->readRefcounts(&super, refcounts.data());
+  }
+
+  parentOf.assign(super.num_inodes, -1);
+  links.assign(super.num_inodes, 0);
+
+  // the root is its own parent
+  int root = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+  string error = inodeError(inodes[root]);
+  if ((inodes[root].type & UFS_TYPE_MASK) != UFS_DIRECTORY || error != "") {
+    problems.push_back("root directory: inode is not a valid directory");
+    return false;
+  }
+  parentOf[root] = root;
+  pendingDirectories.push_back(make_pair(root, root));
+  activeWalkers = 0;
+
+  vector<pthread_t> walkers(threads);
+  for (int i = 0; i < threads; i++) {
+    dthread_create(&walkers[i], NULL, walker, NULL);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(walkers[i], NULL);
+  }
+
+  accountBlocks();
+  checkChecksums();
+  return true;
+}
+
+// fix what the walk found in the directories themselves
+void repairDirectories() {
+  super_t super;
+  fileSystem->readSuperBlock(&super);
+
+  for (size_t i = 0; i < badInodes.size(); i++) {
+    // keep the blocks that are still valid, drop the rest
+    inode_t &inode = inodes[badInodes[i]];
+    bool isDirectory = (inode.type & UFS_TYPE_MASK) == UFS_DIRECTORY;
+    int keep = 0;
+    if (!(inode.type & ~UFS_TYPE_MASK)) {
+      while (keep < DIRECT_PTRS && keep * UFS_BLOCK_SIZE < inode.size && inDataRegion(inode.direct[keep])) {
+	keep++;
+      }
+    }
+    inode.size = min(max(inode.size, 0), keep * UFS_BLOCK_SIZE);
+    if (isDirectory) {
+      inode.size -= inode.size % sizeof(dir_ent_t);
+    }
+    if (isDirectory && inode.size < (int) (2 * sizeof(dir_ent_t))) {
+      // nothing is left, start over as an empty directory
+      dir_ent_t entries[2] = {};
+      strncpy(entries[0].name, ".", DIR_ENT_NAME_SIZE);
+      entries[0].inum = badInodes[i];
+      strncpy(entries[1].name, "..", DIR_ENT_NAME_SIZE);
+      entries[1].inum = parentOf[badInodes[i]];
+      inode.type = UFS_DIRECTORY | UFS_FLAG_INLINE;
+      inode.size = sizeof(entries);
+      memset(inode.direct, 0, sizeof(inode.direct));
+      memcpy(inode.direct, entries, sizeof(entries));
+    } else {
+      inode.type = isDirectory ? UFS_DIRECTORY : UFS_REGULAR_FILE;
+    }
+    fileSystem->writeInode(&super, badInodes[i], &inode);
+  }
+
+  for (size_t i = 0; i < badEntries.size(); i++) {
+    fileSystem->removeEntry(&super, badEntries[i].directory, badEntries[i].name);
+  }
+
+  for (size_t i = 0; i < wrongParents.size(); i++) {
+    int directory = wrongParents[i].first;
+    inode_t inode;
+    fileSystem->readInode(&super, directory, &inode);
+    dir_ent_t block[UFS_BLOCK_SIZE / sizeof(dir_ent_t)];
+    dir_ent_t *entries = block;
+    if (inode.type & UFS_FLAG_INLINE) {
+      entries = (dir_ent_t *) inode.direct;
+    } else {
+      disk->readBlock(inode.direct[0], block);
+    }
+    memset(&entries[0], 0, 2 * sizeof(dir_ent_t));
+    strncpy(entries[0].name, ".", DIR_ENT_NAME_SIZE);
+    entries[0].inum = directory;
+    strncpy(entries[1].name, "..", DIR_ENT_NAME_SIZE);
+    entries[1].inum = wrongParents[i].second;
+    if (inode.type & UFS_FLAG_INLINE) {
+      fileSystem->writeInode(&super, directory, &inode);
+    } else if (fileSystem->writeInodeBlock(&super, &inode, 0, block, NULL) == 0) {
+      fileSystem->writeInode(&super, directory, &inode);
+    }
+  }
+}
+
+// make the bitmaps and refcounts say what accountBlocks counted
+void repairAllocation() {
+  for (int inum = 0; inum < super.num_inodes; inum++) {
+    if (inodeUsed[inum]) {
+      inodeBitmap[inum / 8] |= (1 << (inum % 8));
+    } else {
+      inodeBitmap[inum / 8] &= ~(1 << (inum % 8));
+    }
+  }
+  for (int dataIndex = 0; dataIndex < super.num_data; dataIndex++) {
+    if (blockUses[dataIndex] > 0) {
+      dataBitmap[dataIndex / 8] |= (1 << (dataIndex % 8));
+    } else {
+      dataBitmap[dataIndex / 8] &= ~(1 << (dataIndex % 8));
+    }
+    if (super.refcount_addr != 0) {
+      refcounts[dataIndex] = min(max(blockUses[dataIndex] - 1, 0), UFS_REFCOUNT_MAX);
+    }
+  }
+  fileSystem->writeInodeBitmap(&super, inodeBitmap.data());
+  fileSystem->writeDataBitmap(&super, dataBitmap.data());
+  if (super.refcount_addr != 0) {
+    fileSystem->writeRefcounts(&super, refcounts.data());
+  }
+}
+
+void report() {
+  sort(problems.begin(), problems.end());
+  for (size_t i = 0; i < problems.size(); i++) {
+    cout << problems[i] << endl;
+  }
+}
+
+void usage(char *program) {
+  cerr << program << ": [-r] [-t threads] diskImageFile" << endl;
+  cerr << "  -r  repair what can be repaired" << endl;
+  exit(FSCK_USAGE);
+}
+
+int main(int argc, char *argv[]) {
+  bool repair = false;
+  int option;
+  while ((option = getopt(argc, argv, "rt:")) != -1) {
+    switch (option) {
+    case 'r':
+      repair = true;
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || threads < 1) {
+    usage(argv[0]);
+  }
+
+  disk = new Disk(argv[optind], UFS_BLOCK_SIZE);
+  fileSystem = new LocalFileSystem(disk);
+  imageFd = open(argv[optind], O_RDONLY);
+  if (imageFd < 0) {
+    cerr << "Could not open " << argv[optind] << endl;
+    return FSCK_UNCORRECTED;
+  }
+
+  bool complete = check();
+  report();
+
+  int result = FSCK_OK;
+  if (!problems.empty()) {
+    result = FSCK_UNCORRECTED;
+  }
+  if (!problems.empty() && repair && complete) {
+    // Fixing directories changes what is reachable, so count again after.
+    // A truncated directory can reveal more to fix below it.
+    for (int pass = 0; pass < 8 && complete &&
+	   (!badInodes.empty() || !badEntries.empty() || !wrongParents.empty()); pass++) {
+      repairDirectories();
+      complete = check();
+    }
+    if (complete) {
+      repairAllocation();
+    }
+    check();
+    cout << endl << "After repair" << endl;
+    report();
+    result = problems.empty() ? FSCK_CORRECTED : FSCK_UNCORRECTED;
+  }
+  if (result == FSCK_OK) {
+    cout << "clean" << endl;
+  }
+
+  close(imageFd);
+  delete fileSystem;
+  delete disk;
+  return result;
+}
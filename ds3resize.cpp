@@ -0,0 +1,52 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "LocalFileSystem.h"
+#include "Disk.h"
+#include "ufs.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    cerr << argv[0] << ": diskImageFile numInodes numDataBlocks" << endl;
+    cerr << "For example:" << endl;
+    cerr << "    $ " << argv[0] << " a.img 256 4096" << endl;
+    return 1;
+  }
+
+  // Parse command line arguments
+  Disk *disk = new Disk(argv[1], UFS_BLOCK_SIZE);
+  LocalFileSystem *fileSystem = new LocalFileSystem(disk);
+  long long numInodes = atoll(argv[2]);
+  long long numData = atoll(argv[3]);
+  if (numInodes < 0 || numData < 0 || numInodes > RESIZE_MAX_INODES || numData > RESIZE_MAX_DATA_BLOCKS) {
+    cerr << "Error resizing: at most " << RESIZE_MAX_INODES << " inodes and "
+	 << RESIZE_MAX_DATA_BLOCKS << " data blocks" << endl;
+    delete fileSystem;
+    delete disk;
+    return 1;
+  }
+
+  disk->beginTransaction();
+  int moved = fileSystem->resize(numInodes, numData);
+  if (moved < 0) {
+    disk->rollback();
+    cerr << "Error resizing: images only grow" << endl;
+    delete fileSystem;
+    delete disk;
+    return 1;
+  }
+  disk->commit();
+
+  super_t super;
+  fileSystem->readSuperBlock(&super);
+  cout << "inodes " << super.num_inodes << ", data blocks " << super.num_data
+       << ", " << moved << " data blocks moved" << endl;
+
+  delete fileSystem;
+  delete disk;
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Disk.h"
+#include "StripedDisk.h"
+#include "ufs.h"
+
+using namespace std;
+
+// blocks copied per batch
+#define COPY_BLOCKS (256)
+
+// an empty file of the given size, replacing whatever was there
+static void create(string file, off_t size) {
+  int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, size) != 0) {
+    cerr << "Could not create " << file << endl;
+    exit(1);
+  }
+  close(fd);
+}
+
+static void copy(Disk *from, Disk *to) {
+  vector<unsigned char> buffer(COPY_BLOCKS * UFS_BLOCK_SIZE);
+  for (int first = 0; first < from->numberOfBlocks(); first += COPY_BLOCKS) {
+    vector<int> blocks;
+    for (int i = first; i < first + COPY_BLOCKS && i < from->numberOfBlocks(); i++) {
+      blocks.push_back(i);
+    }
+    from->readBlocks(blocks, buffer.data());
+    // the new files are sparse and read as zeros already
+    size_t length = blocks.size() * UFS_BLOCK_SIZE;
+    if (buffer[0] == 0 && memcmp(buffer.data(), buffer.data() + 1, length - 1) == 0) {
+      continue;
+    }
+    to->writeBlocks(blocks, buffer.data());
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool join = false;
+  int stripeBlocks = STRIPE_BLOCKS;
+  int option;
+  while ((option = getopt(argc, argv, "jw:")) != -1) {
+    switch (option) {
+    case 'j':
+      join = true;
+      break;
+    case 'w':
+      stripeBlocks = atoi(optarg);
+      break;
+    default:
+      argc = 0;
+    }
+  }
+  if (argc - optind < 2 || stripeBlocks <= 0) {
+    cerr << argv[0] << ": [-j] [-w stripeBlocks] diskImageFile partFile..." << endl;
+    cerr << "Cuts an image into parts for gunrock_web -i part,part,... or, with -j," << endl;
+    cerr << "joins the parts back into one image. For example:" << endl;
+    cerr << "    $ " << argv[0] << " a.img /ssd0/a.0 /ssd1/a.1" << endl;
+    return 1;
+  }
+
+  string imageFile = argv[optind];
+  vector<string> partFiles(argv + optind + 1, argv + argc);
+  Disk *image;
+  StripedDisk *striped;
+  if (join) {
+    striped = new StripedDisk(partFiles, UFS_BLOCK_SIZE, stripeBlocks);
+    create(imageFile, (off_t) striped->numberOfBlocks() * UFS_BLOCK_SIZE);
+    image = new Disk(imageFile, UFS_BLOCK_SIZE);
+    copy(striped, image);
+  } else {
+    image = new Disk(imageFile, UFS_BLOCK_SIZE);
+    int parts = partFiles.size();
+    for (int i = 0; i < parts; i++) {
+      create(partFiles[i], (off_t) StripedDisk::partBlocks(i, parts, stripeBlocks, image->numberOfBlocks()) *
+	     UFS_BLOCK_SIZE);
+    }
+    striped = new StripedDisk(partFiles, UFS_BLOCK_SIZE, stripeBlocks);
+    copy(image, striped);
+  }
+
+  cout << image->numberOfBlocks() << " blocks, " << partFiles.size() << " parts of "
+       << stripeBlocks << " block stripes" << endl;
+  delete striped;
+  delete image;
+  return 0;
+}
@@ -119,6 +119,15 @@ int dthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
   return ret;
 }
 
+int dthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+			   const struct timespec *abstime) {
+  sync_print_thread("dthread_cond_timedwait_enter", mutex, cond);
+  int ret = pthread_cond_timedwait(cond, mutex, abstime);
+  sync_print_thread("dthread_cond_timedwait_return", mutex, cond);
+
+  return ret;
+}
+
 int dthread_cond_signal(pthread_cond_t *cond) {
   sync_print_thread("dthread_cond_signal_enter", NULL, cond);
   int ret = pthread_cond_signal(cond);
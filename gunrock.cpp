@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <fstream>
 #include <deque>
 
 #include "ClientError.h"
@@ -18,21 +19,52 @@
 #include "HttpUtils.h"
 #include "FileService.h"
 #include "DistributedFileSystemService.h"
+#include "ReadProxyService.h"
+#include "SnapshotService.h"
+#include "ResizeService.h"
+#include "MmapDisk.h"
+#include "UringDisk.h"
+#include "DirectDisk.h"
+#include "StripedDisk.h"
+#include "MirroredDisk.h"
 #include "MySocket.h"
 #include "MyServerSocket.h"
 #include "dthread.h"
+#include "StringUtils.h"
 
 using namespace std;
 int PORT = 8080;
-int THREAD_POOL_SIZE = 1;
-int BUFFER_SIZE = 1;
+// watch requests park a worker until something changes, so one thread
+// is not enough
+int THREAD_POOL_SIZE = 8;
+int BUFFER_SIZE = 16;
 string BASEDIR = "ds3";
 string SCHEDALG = "FIFO";
 string LOGFILE = "/dev/null";
 string DISKFILE = "disk.img";
+string REPLICAS = "";
+string NODEID = "";
+string REPLICA_KEY_FILE = "";
+int REPLICA_TIMEOUT_MS = 2000;
+string PROXY_PEERS = "";
+int HEDGE_PERCENTILE = 95;
+int HEDGE_INITIAL_DELAY_MS = 10;
+int LEASE_MS = 0;
+bool COMPRESS = false;
+string UNVERIFIED_REGIONS = "";
+string DISK_BACKEND = "file";
+int CACHE_BLOCKS = DIRECT_CACHE_BLOCKS;
+int STRIPE_WIDTH = STRIPE_BLOCKS;
+int DEFRAG_BLOCKS_PER_SECOND = 0;
 
 vector<HttpService *> services;
 
+// accepted connections waiting for a worker, at most BUFFER_SIZE of them
+deque<MySocket *> pending;
+pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pending_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pending_not_full = PTHREAD_COND_INITIALIZER;
+
 HttpService *find_service(HTTPRequest *request) {
    // find a service that is registered for this path prefix
   for (unsigned int idx = 0; idx < services.size(); idx++) {
@@ -65,6 +97,8 @@ void invoke_service_method(HttpService *service, HTTPRequest *request, HTTPRespo
       service->del(request, response);
     } else if (request->isMove()) {
       service->move(request, response);
+    } else if (request->isCopy()) {
+      service->copy(request, response);
     } else {
       // The server doesn't know about this method
       response->setStatus(501);
@@ -122,12 +156,43 @@ void handle_request(MySocket *client) {
   delete client;
 }
 
+void *worker(void *arg) {
+  while (true) {
+    dthread_mutex_lock(&pending_lock);
+    while (pending.empty()) {
+      dthread_cond_wait(&pending_not_empty, &pending_lock);
+    }
+    MySocket *client = pending.front();
+    pending.pop_front();
+    dthread_cond_signal(&pending_not_full);
+    dthread_mutex_unlock(&pending_lock);
+
+    handle_request(client);
+  }
+  return NULL;
+}
+
+// the secret replicas share, the first line of keyFile
+string readReplicaSecret(string keyFile) {
+  ifstream file(keyFile.c_str());
+  string secret;
+  getline(file, secret);
+  while (!secret.empty() && isspace((unsigned char) secret.back())) {
+    secret.pop_back();
+  }
+  if (secret.empty()) {
+    cerr << "replication needs a shared secret, give every replica the same -K keyFile" << endl;
+    exit(1);
+  }
+  return secret;
+}
+
 int main(int argc, char *argv[]) {
 
   signal(SIGPIPE, SIG_IGN);
   int option;
 
-  while ((option = getopt(argc, argv, "d:p:t:b:s:l:i:")) != -1) {
+  while ((option = getopt(argc, argv, "d:p:t:b:s:l:i:r:n:T:P:H:L:zX:F:D:C:W:K:")) != -1) {
     switch (option) {
     case 'd':
       BASEDIR = string(optarg);
@@ -150,8 +215,49 @@ int main(int argc, char *argv[]) {
     case 'i':
       DISKFILE = string(optarg);
       break;
+    case 'r':
+      REPLICAS = string(optarg);
+      break;
+    case 'n':
+      NODEID = string(optarg);
+      break;
+    case 'T':
+      REPLICA_TIMEOUT_MS = atoi(optarg);
+      break;
+    case 'P':
+      PROXY_PEERS = string(optarg);
+      break;
+    case 'H':
+      HEDGE_PERCENTILE = atoi(optarg);
+      break;
+    case 'L':
+      LEASE_MS = atoi(optarg);
+      break;
+    case 'z':
+      COMPRESS = true;
+      break;
+    case 'X':
+      UNVERIFIED_REGIONS = string(optarg);
+      break;
+    case 'F':
+      DEFRAG_BLOCKS_PER_SECOND = atoi(optarg);
+      break;
+    case 'D':
+      DISK_BACKEND = string(optarg);
+      break;
+    case 'C':
+      CACHE_BLOCKS = atoi(optarg);
+      break;
+    case 'W':
+      STRIPE_WIDTH = atoi(optarg);
+      break;
+    case 'K':
+      REPLICA_KEY_FILE = string(optarg);
+      break;
     default:
-      cerr<< "usage: " << argv[0] << " [-p port] [-t threads] [-b buffers] [-i diskFile]" << endl;
+      cerr<< "usage: " << argv[0] << " [-p port] [-t threads] [-b buffers] [-i diskFile[,diskFile...] [-W stripeBlocks]] [-D file|mmap|uring|direct|mirror [-C cacheBlocks]] [-L leaseMs] [-z] [-X region,...] [-F blocksPerSecond]"
+	  << " [-r host:port,... -K keyFile [-n nodeId] [-T timeoutMs]]"
+	  << " [-P host:port,... [-H hedgePercentile]]" << endl;
       exit(1);
     }
   }
@@ -166,13 +272,90 @@ int main(int argc, char *argv[]) {
 
   // The order that you push services dictates the search order
   // for path prefix matching
-  services.push_back(new DistributedFileSystemService(DISKFILE));
+  if (PROXY_PEERS != "") {
+    // read proxy mode: /ds3/ GETs are hedged across the peers
+    services.push_back(new ReadProxyService(StringUtils::split(PROXY_PEERS, ','), HEDGE_PERCENTILE,
+					    HEDGE_INITIAL_DELAY_MS, REPLICA_TIMEOUT_MS));
+  } else {
+    Disk *disk;
+    vector<string> diskFiles = StringUtils::split(DISKFILE, ',');
+    if (DISK_BACKEND == "mirror") {
+      disk = new MirroredDisk(diskFiles, UFS_BLOCK_SIZE);
+    } else if (diskFiles.size() > 1) {
+      // the parts of a striped image, cut by ds3stripe
+      if (DISK_BACKEND != "file") {
+	cerr << "striped images only use the file backend" << endl;
+	exit(1);
+      }
+      disk = new StripedDisk(diskFiles, UFS_BLOCK_SIZE, STRIPE_WIDTH);
+    } else if (DISK_BACKEND == "file") {
+      disk = new Disk(DISKFILE, UFS_BLOCK_SIZE);
+    } else if (DISK_BACKEND == "mmap") {
+      disk = new MmapDisk(DISKFILE, UFS_BLOCK_SIZE);
+    } else if (DISK_BACKEND == "uring") {
+      disk = new UringDisk(DISKFILE, UFS_BLOCK_SIZE);
+    } else if (DISK_BACKEND == "direct") {
+      disk = new DirectDisk(DISKFILE, UFS_BLOCK_SIZE, CACHE_BLOCKS);
+    } else {
+      cerr << "unknown disk backend " << DISK_BACKEND << endl;
+      exit(1);
+    }
+    DistributedFileSystemService *ds3 = new DistributedFileSystemService(disk);
+    if (REPLICAS != "") {
+      // a coordinating worker waits on its peers, and their coordinating
+      // workers on us, so each side needs a worker left for the other
+      if (THREAD_POOL_SIZE < 2) {
+	cerr << "replication needs at least two worker threads, see -t" << endl;
+	exit(1);
+      }
+      if (NODEID == "") {
+	stringstream nodeId;
+	nodeId << "localhost:" << PORT;
+	NODEID = nodeId.str();
+      }
+      ds3->enableReplication(NODEID, StringUtils::split(REPLICAS, ','), REPLICA_TIMEOUT_MS,
+			     readReplicaSecret(REPLICA_KEY_FILE));
+    }
+    if (LEASE_MS > 0) {
+      ds3->enableLeases(LEASE_MS);
+    }
+    // no other thread runs yet, so the file system lock isn't needed
+    ds3->localFileSystem()->setCompression(COMPRESS);
+    vector<string> regions = StringUtils::split(UNVERIFIED_REGIONS, ',');
+    for (size_t idx = 0; idx < regions.size(); idx++) {
+      if (ds3->localFileSystem()->verifyChecksums(regions[idx], false) != 0) {
+	cerr << "can't skip checksums of " << regions[idx] << endl;
+	exit(1);
+      }
+    }
+    // a worker stays free for everything but watches
+    ds3->limitWatchers(THREAD_POOL_SIZE - 1);
+    if (DEFRAG_BLOCKS_PER_SECOND > 0) {
+      ds3->enableDefragmentation(DEFRAG_BLOCKS_PER_SECOND);
+    }
+    services.push_back(ds3);
+    services.push_back(new SnapshotService(ds3));
+    services.push_back(new ResizeService(ds3));
+  }
   services.push_back(new FileService(BASEDIR));
-  
+
+  for (int idx = 0; idx < THREAD_POOL_SIZE; idx++) {
+    pthread_t thread;
+    dthread_create(&thread, NULL, worker, NULL);
+    dthread_detach(thread);
+  }
+
   while(true) {
     sync_print("waiting_to_accept", "");
     client = server->accept();
     sync_print("client_accepted", "");
-    handle_request(client);
+
+    dthread_mutex_lock(&pending_lock);
+    while ((int) pending.size() >= BUFFER_SIZE) {
+      dthread_cond_wait(&pending_not_full, &pending_lock);
+    }
+    pending.push_back(client);
+    dthread_cond_signal(&pending_not_empty);
+    dthread_mutex_unlock(&pending_lock);
   }
 }
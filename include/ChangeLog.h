@@ -0,0 +1,61 @@
+#ifndef _CHANGE_LOG_H_
+#define _CHANGE_LOG_H_
+
+#include <pthread.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#define WATCH_VERSION_HEADER "X-Watch-Version"
+
+// how many mutations the log remembers for slow watchers
+#define CHANGE_LOG_ENTRIES (4096)
+
+/**
+ * An in-memory log of the paths that PUT and DELETE changed.
+ *
+ * Every mutation gets the next version number. Watchers block until a
+ * path at or below the one they watch changes after the version they
+ * last saw, so clients that used to poll directory listings cost
+ * nothing while nothing changes.
+ *
+ * Paths are given without leading or trailing slashes, "" is the root.
+ */
+class ChangeLog {
+ public:
+  ChangeLog();
+
+  // the version of the most recent mutation
+  unsigned long current();
+
+  // record a mutation of path, returns its version
+  unsigned long record(std::string path);
+
+  /**
+   * Block until a path below `path` changes after version `since`, or
+   * until timeoutMs milliseconds have passed.
+   *
+   * Fills in the changed paths and sets *latest to the newest version.
+   * Returns false when the log no longer reaches back to `since`, the
+   * watcher then has to re-read the directory.
+   */
+  bool waitForChange(std::string path, unsigned long since, int timeoutMs,
+		     unsigned long *latest, std::vector<std::string> *changed);
+
+ private:
+  struct Change {
+    unsigned long version;
+    std::string path;
+  };
+
+  static bool isBelow(std::string changed, std::string watched);
+  bool collect(std::string path, unsigned long since, std::vector<std::string> *changed);
+
+  pthread_mutex_t m_lock;
+  pthread_cond_t m_changed;
+  std::deque<struct Change> m_log;
+  unsigned long m_version;
+};
+
+#endif
@@ -17,6 +17,8 @@ class ClientError : public std::runtime_error {
   static ClientError notFound() { return ClientError("Not Found", 404); }
   static ClientError methodNotAllowed() { return ClientError("Method Not Allowed", 405); }
   static ClientError conflict() { return ClientError("Conflict", 409); }
+  static ClientError notImplemented() { return ClientError("Not Implemented", 501); }
+  static ClientError serviceUnavailable() { return ClientError("Service Unavailable", 503); }
   static ClientError insufficientStorage() { return ClientError("Insufficient Storage", 507); }
 };
 
@@ -0,0 +1,14 @@
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli), the checksum behind SSE4.2's crc32 instruction.
+// Uses the instruction when the CPU has it and a table otherwise.
+class Crc32c {
+public:
+  static uint32_t checksum(const void *data, size_t len);
+};
+
+#endif
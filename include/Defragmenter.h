@@ -0,0 +1,42 @@
+#ifndef _DEFRAGMENTER_H_
+#define _DEFRAGMENTER_H_
+
+#include <pthread.h>
+
+#include "LocalFileSystem.h"
+
+// how many inodes one step looks at for a file to move
+#define DEFRAG_SCAN_INODES (64)
+// the pause after a pass over all inodes
+#define DEFRAG_IDLE_MS (10000)
+
+/**
+ * Moves the blocks of fragmented files into contiguous runs in a
+ * background thread while the server runs.
+ *
+ * Every file moves in its own transaction, under the lock that guards
+ * the file system, so requests only ever wait for one file. After a
+ * move the thread sleeps long enough to keep the blocks it copies below
+ * blocksPerSecond.
+ */
+class Defragmenter {
+ public:
+  Defragmenter(LocalFileSystem *fileSystem, pthread_mutex_t *lock, int blocksPerSecond);
+
+  void start();
+
+  // blocks moved since start()
+  unsigned long moved();
+
+ private:
+  static void *run(void *defragmenter);
+  int step(bool *passDone);
+
+  LocalFileSystem *m_fileSystem;
+  pthread_mutex_t *m_lock;
+  int m_blocksPerSecond;
+  int m_cursor;
+  unsigned long m_moved;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _DIRECT_DISK_H_
+#define _DIRECT_DISK_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Disk.h"
+
+// blocks cached when gunrock isn't told otherwise, 4 MB of 4 KB blocks
+#define DIRECT_CACHE_BLOCKS (1024)
+// the most blocks one pread or pwrite moves, the size of the staging buffer
+#define DIRECT_RUN_BLOCKS (64)
+
+/**
+ * A Disk that opens the image with O_DIRECT, so its blocks never sit in
+ * the kernel's page cache. It keeps its own least recently used cache of
+ * a fixed number of blocks instead. Writes go through to the image and
+ * update the cache, reads of cached blocks don't touch the image.
+ *
+ * O_DIRECT transfers need block aligned memory, so all of them go through
+ * buffers allocated once, up front: the cache slots and a staging buffer
+ * for runs of adjacent blocks. The memory used never changes after
+ * construction. File systems that refuse O_DIRECT get a warning and the
+ * page cache.
+ */
+class DirectDisk : public Disk {
+ public:
+  DirectDisk(std::string imageFile, int blockSize, int cacheBlocks = DIRECT_CACHE_BLOCKS);
+  virtual ~DirectDisk();
+
+  unsigned long cacheHits() { return hits; }
+  unsigned long cacheMisses() { return misses; }
+
+ protected:
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+
+ private:
+  int fd;
+  int cacheBlocks;
+  unsigned char *slots;
+  unsigned char *staging;
+
+  // block number to slot, and the slots from most to least recently used
+  std::map<int, int> cached;
+  std::vector<int> slotBlock;
+  std::list<int> recency;
+  std::vector<std::list<int>::iterator> recencyOf;
+  unsigned long hits;
+  unsigned long misses;
+
+  unsigned char *lookup(int blockNumber);
+  void remember(int blockNumber, const unsigned char *data);
+  void transfer(bool write, int firstBlock, int count);
+};
+
+#endif
@@ -1,8 +1,16 @@
 #ifndef _DISK_H_
 #define _DISK_H_
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #include <string>
 #include <deque>
+#include <set>
+#include <vector>
+
+// undo buffers kept for the next transaction, the rest are freed
+#define UNDO_POOL_BLOCKS (1024)
 
 struct UndoRecord {
   int blockNumber;
@@ -12,20 +20,87 @@ struct UndoRecord {
 class Disk {
  public:
   Disk(std::string imageFile, int blockSize);
+  virtual ~Disk();
   void readBlock(int blockNumber, void *buffer);
   void writeBlock(int blockNumber, void *buffer);
+  // Read a batch of blocks, block i into buffer + i * blockSize. Backends
+  // that keep several reads in flight hand the whole batch to the kernel.
+  void readBlocks(const std::vector<int> &blockNumbers, void *buffer);
+  // Write a batch of blocks from consecutive slots of buffer, in order.
+  // Inside a transaction the batch is undone like single writes.
+  void writeBlocks(const std::vector<int> &blockNumbers, const void *buffer);
   int numberOfBlocks();
+  // Extend the image with zeroed blocks, it never shrinks
+  virtual void grow(int numberOfBlocks);
 
   void beginTransaction();
   void commit();
   void rollback();
-  
- private:
+
+  // Undo only the writes made after savepoint() returned, the
+  // transaction stays open. Writes inside a transaction are synced to
+  // the image once, at commit.
+  int savepoint();
+  void rollbackTo(int savepoint);
+
+  // Keep a CRC32C of every block in the table at blocks
+  // [tableAddr, tableAddr + tableLen) and check blocks against it as they
+  // are read. A checksum of 0 is never checked, fresh tables are all 0.
+  void enableChecksums(int tableAddr, int tableLen);
+  // Keep the table at a new place from now on, with room for a grown
+  // image. The entries come along, so it is written out in full.
+  void moveChecksums(int tableAddr, int tableLen);
+  // Stop or resume checking a range of blocks on read. Writes keep their
+  // checksums current either way, so checking can be turned back on.
+  void verifyChecksums(int firstBlock, int count, bool enabled);
+  // reads whose data didn't match the checksum table
+  unsigned long checksumMismatches();
+
+ protected:
   std::string imageFile;
   int blockSize;
-  int imageFileSize;
+  off_t imageFileSize;
+
+  // for backends whose image isn't the one file imageFile names
+  Disk(std::string imageFile, int blockSize, off_t imageFileSize);
+
+  // Storage backends override these. The transactions, undo log and
+  // checksums above them work the same for every backend. sync() makes
+  // the writes so far durable.
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+  // make the image size bytes long, the new blocks zeroed
+  virtual void extend(off_t size);
+
+  // runs of consecutive block numbers in a batch, as (first index, length)
+  static std::vector<std::pair<int, int> > runs(const std::vector<int> &blockNumbers);
+
+ private:
   bool isInTransaction;
   std::deque<struct UndoRecord> undoLog;
+  // Blocks with an undo record since the last savepoint. Another write
+  // to one of them needs no record, undoing the first restores the block.
+  std::set<int> loggedBlocks;
+  std::vector<unsigned char *> undoPool;
+
+  int checksumAddr;
+  int checksumLen;
+  std::vector<uint32_t> checksums;
+  std::vector<bool> verify;
+  // table blocks changed by the open transaction, written at commit
+  std::set<int> dirtyChecksumBlocks;
+  unsigned long mismatches;
+
+  unsigned char *undoBuffer();
+  void releaseUndoBuffer(unsigned char *buffer);
+  void releaseUndoLog();
+  void checkBlock(int blockNumber, const void *buffer);
+  void updateChecksum(int blockNumber, const void *buffer);
+  bool hasChecksum(int blockNumber);
+  void writeChecksumBlock(int tableBlock);
 };
 
 #endif
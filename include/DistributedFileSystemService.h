@@ -1,21 +1,142 @@
 #ifndef _DISTRIBUTEDFILESYSTEMSERVICE_H_
 #define _DISTRIBUTEDFILESYSTEMSERVICE_H_
 
+#include <pthread.h>
+
+#include "ChangeLog.h"
+#include "Defragmenter.h"
 #include "HttpService.h"
+#include "LeaseTable.h"
 #include "LocalFileSystem.h"
+#include "ReplicaSet.h"
+#include "VersionVector.h"
 
+#include <map>
 #include <string>
+#include <vector>
+
+// how long a watch blocks when the request does not say
+#define WATCH_DEFAULT_TIMEOUT_MS (30000)
+// and the longest it blocks whatever the request says
+#define WATCH_MAX_TIMEOUT_MS (60000)
+
+// the most operations one POST batch may carry, they all share one undo log
+#define BATCH_MAX_OPERATIONS (4096)
 
 class DistributedFileSystemService : public HttpService {
  public:
-  DistributedFileSystemService(std::string driveFile);
+  // serves the image behind disk, see Disk and its subclasses for the backends
+  DistributedFileSystemService(Disk *disk);
 
   virtual void get(HTTPRequest *request, HTTPResponse *response);
   virtual void put(HTTPRequest *request, HTTPResponse *response);
   virtual void del(HTTPRequest *request, HTTPResponse *response);
+  virtual void post(HTTPRequest *request, HTTPResponse *response);
+  virtual void move(HTTPRequest *request, HTTPResponse *response);
+  virtual void copy(HTTPRequest *request, HTTPResponse *response);
+
+  /**
+   * Turn on the replicated mode. nodeId names this node in version
+   * vectors and peers lists the other replicas as host:port. GET and PUT
+   * requests are then coordinated across the replicas using the
+   * consistency level from the X-Consistency header. DELETE, MOVE, COPY
+   * and POST batches are refused, they carry no versions.
+   *
+   * A PUT is written locally first and then sent to the other replicas.
+   * When fewer than the consistency level take it, the client gets 503,
+   * but the write may still have been applied: the replicas that took it
+   * keep it, and read repair spreads it to the rest. A client retrying
+   * after 503 must expect the new contents to show up either way.
+   *
+   * Requests between replicas carry secret in the X-Ds3-Replica header,
+   * every replica must be given the same one. Requests without it are
+   * treated as coming from a client.
+   */
+  void enableReplication(std::string nodeId, std::vector<std::string> peers, int timeoutMs,
+			 std::string secret);
+
+  /**
+   * Grant clients read leases of leaseMs milliseconds on every GET, see
+   * LeaseTable. Clients poll GET /ds3/?invalidations=<seq> for leases that
+   * PUT and DELETE revoked early.
+   */
+  void enableLeases(int leaseMs);
+
+  /**
+   * Start moving fragmented files into contiguous runs of blocks in the
+   * background, copying at most blocksPerSecond blocks a second.
+   */
+  void enableDefragmentation(int blocksPerSecond);
+
+  /**
+   * Let at most maxWatchers watch requests block at once, later ones get
+   * 503 until one returns. Each watcher holds a worker thread, so this
+   * should leave some of the pool for other requests.
+   */
+  void limitWatchers(int maxWatchers);
+
+  // for services that share this file system, like SnapshotService. Hold
+  // fileSystemLock() while using localFileSystem().
+  LocalFileSystem *localFileSystem() { return fileSystem; }
+  pthread_mutex_t *fileSystemLock() { return &lock; }
+
+  // a file's contents, or a directory listing, read from fileSystem
+  static std::string readPath(LocalFileSystem *fileSystem, std::string path, bool *isDirectory);
 
 private:
+  // a newer copy of a file for our own replica, see repairLocal
+  struct LocalRepair {
+    DistributedFileSystemService *service;
+    std::string path;
+    std::string body;
+    VersionVector version;
+  };
+
+  struct BatchOperation {
+    bool isDelete;
+    std::string path;
+    std::string body;
+    int status;
+  };
+
+  // local, single node versions of get and put
+  void writePath(std::string path, std::string body);
+  void invalidations(unsigned long since, HTTPResponse *response);
+  void watch(std::string path, unsigned long since, int timeoutMs, HTTPResponse *response);
+
+  // building blocks for PUT, DELETE and batches, the caller owns the transaction
+  int resolveDirectory(const std::vector<std::string> &tokens, size_t count, bool create,
+		       std::map<std::string, int> *directories);
+  void applyPut(std::string path, std::string body, std::map<std::string, int> *directories);
+  void applyDelete(std::string path, std::map<std::string, int> *directories);
+  static std::vector<BatchOperation> parseBatch(std::string body);
+
+  // replicated versions of get and put
+  void coordinatedGet(std::string path, HTTPRequest *request, HTTPResponse *response);
+  void coordinatedPut(std::string path, HTTPRequest *request, HTTPResponse *response);
+  int replicasNeeded(HTTPRequest *request);
+  bool isReplicaRequest(HTTPRequest *request);
+  static void *repairLocal(void *arg);
+  static std::string optionalHeader(HTTPRequest *request, std::string key);
+  static std::map<std::string, std::string> queryParams(HTTPRequest *request);
+  std::string destinationPath(HTTPRequest *request);
+  static std::string pathKey(std::string path);
+
+  // serializes every use of fileSystem and versions between worker threads
+  pthread_mutex_t lock;
   LocalFileSystem *fileSystem;
+
+  std::string nodeId;
+  ReplicaSet *replicas;
+  std::string replicaSecret;
+  std::map<std::string, VersionVector> versions;
+  LeaseTable *leases;
+  ChangeLog *changes;
+  // guards watchers, the watch requests blocked right now
+  pthread_mutex_t watchLock;
+  int watchers;
+  int maxWatchers;
+  Defragmenter *defragmenter;
 };
 
 #endif
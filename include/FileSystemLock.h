@@ -0,0 +1,23 @@
+#ifndef _FILE_SYSTEM_LOCK_H_
+#define _FILE_SYSTEM_LOCK_H_
+
+#include <pthread.h>
+
+#include "dthread.h"
+
+// holds a file system lock until the end of the scope, also when a
+// ClientError is thrown
+class FileSystemLock {
+ public:
+  FileSystemLock(pthread_mutex_t *lock) {
+    this->lock = lock;
+    dthread_mutex_lock(lock);
+  }
+  ~FileSystemLock() {
+    dthread_mutex_unlock(lock);
+  }
+ private:
+  pthread_mutex_t *lock;
+};
+
+#endif
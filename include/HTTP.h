@@ -29,6 +29,7 @@ class HTTP {
     bool isPost() {return m_method == HTTP_POST;}
     bool isDelete() {return m_method == HTTP_DELETE;}
     bool isMove() {return m_method == HTTP_MOVE;}
+    bool isCopy() {return m_method == HTTP_COPY;}
     std::string getBody();
     std::string getQuery() {return m_query;}
     std::vector< std::pair< std::string *, std::string *> > getHeaders() {
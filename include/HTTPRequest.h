@@ -34,6 +34,7 @@ public:
   bool isPost() {return m_http->isPost();}
   bool isDelete() {return m_http->isDelete();}
   bool isMove() {return m_http->isMove();}
+  bool isCopy() {return m_http->isCopy();}
   std::map<std::string, std::string> getParams();
   WwwFormEncodedDict formEncodedBody();
   std::string getBody() {return m_http->getBody();}
@@ -19,6 +19,7 @@ class HttpService {
   virtual void post(HTTPRequest *request, HTTPResponse *response);
   virtual void del(HTTPRequest *request, HTTPResponse *response);
   virtual void move(HTTPRequest *request, HTTPResponse *response);
+  virtual void copy(HTTPRequest *request, HTTPResponse *response);
   
  private:
   std::string m_pathPrefix;
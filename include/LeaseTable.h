@@ -0,0 +1,65 @@
+#ifndef _LEASE_TABLE_H_
+#define _LEASE_TABLE_H_
+
+#include <pthread.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define LEASE_HEADER "X-Lease"
+
+/**
+ * Read leases handed out by the ds3 service.
+ *
+ * A GET grants the client a lease on the path it read, during which the
+ * client may serve the path from its own cache. Writes and deletes revoke
+ * the leases on the path and on every directory above it, whose listings
+ * change too. Revocations are numbered and kept in a log that clients
+ * poll, so a cached copy is dropped as soon as the server changes it.
+ *
+ * Paths are given without leading or trailing slashes, "" is the root.
+ */
+class LeaseTable {
+ public:
+  LeaseTable(int leaseMs);
+
+  int leaseMs() { return m_leaseMs; }
+
+  // grant a lease on path, returns the value for the X-Lease header
+  std::string grant(std::string path);
+
+  // revoke any outstanding leases on path and its ancestors, with subtree
+  // also those below path (a directory that moved)
+  void revoke(std::string path, bool subtree = false);
+
+  /**
+   * The revocations after sequence number `since`.
+   *
+   * Sets *latest to the newest sequence number. Returns false when the
+   * log no longer reaches back to `since`, in which case the client must
+   * drop its whole cache.
+   */
+  bool revokedSince(unsigned long since, unsigned long *latest, std::vector<std::string> *paths);
+
+ private:
+  struct Revocation {
+    unsigned long sequence;
+    long long time;
+    std::string path;
+  };
+
+  static long long nowMs();
+  void trim(long long now);
+
+  int m_leaseMs;
+  pthread_mutex_t m_lock;
+  std::map<std::string, long long> m_expiry;
+  std::deque<struct Revocation> m_log;
+  unsigned long m_sequence;
+  unsigned long m_trimmed;
+  long long m_nextSweep;
+};
+
+#endif
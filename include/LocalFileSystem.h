@@ -1,7 +1,11 @@
 #ifndef _LOCAL_FILE_SYSTEM_H_
 #define _LOCAL_FILE_SYSTEM_H_
 
+#include <stdint.h>
+
+#include <map>
 #include <string>
+#include <vector>
 
 #include "Disk.h"
 #include "ufs.h"
@@ -23,6 +27,12 @@
 // whichever error makes the most sense in your implementation and
 // it will be considered correct.
 
+// The most inodes and data blocks resize grows an image to. It holds the
+// new inode table, refcounts and fingerprints in memory, and a whole data
+// bitmap is in memory on every write.
+#define RESIZE_MAX_INODES (1 << 20)
+#define RESIZE_MAX_DATA_BLOCKS (1 << 22)
+
 // the operation failed because there wasn't enough space on the disk
 #define ENOTENOUGHSPACE    (1)
 // Unlinking a directory that is _not_ empty
@@ -43,6 +53,12 @@
 #define EINVALIDTYPE       (9)
 // Unlinking '.' or '..'
 #define EUNLINKNOTALLOWED  (10)
+// Moving a directory into itself or one of its subdirectories
+#define EMOVEINTOSELF      (11)
+// Changing a read-only snapshot view
+#define EREADONLY          (12)
+// The image was made without the region the operation needs
+#define ENOTSUPPORTED      (13)
 
 class LocalFileSystem {
  public:
@@ -100,6 +116,22 @@ class LocalFileSystem {
    */
   int write(int inodeNumber, const void *buffer, int size);
 
+  /**
+   * Compress the files that write stores from now on, when that saves at
+   * least one data block. Files keep the form they were last written in.
+   */
+  void setCompression(bool enabled);
+
+  /**
+   * Turn checking blocks against the checksum table on read on or off for
+   * one region: "super", "bitmaps", "inodes" or "data".
+   *
+   * Success: 0
+   * Failure: -ENOTSUPPORTED, -EINVALIDNAME
+   * Failure modes: the image has no checksum table, unknown region.
+   */
+  int verifyChecksums(std::string region, bool enabled);
+
   /**
    * Read the contents of a file or directory.
    *
@@ -126,6 +158,109 @@ class LocalFileSystem {
    * existing is NOT a failure by our definition. You can't unlink '.' or '..'
    */
   int unlink(int parentInodeNumber, std::string name);
+
+  /**
+   * Move a file or directory.
+   *
+   * Moves the entry srcName in directory srcParentInodeNumber to dstName in
+   * directory dstParentInodeNumber. Only directory entries are rewritten,
+   * the inode and its data stay where they are. An existing destination of
+   * the same type is replaced, for directories only if it is empty.
+   *
+   * Success: 0
+   * Failure: -EINVALIDINODE, -ENOTFOUND, -EINVALIDNAME, -EINVALIDTYPE,
+   * -EDIRNOTEMPTY, -EUNLINKNOTALLOWED, -EMOVEINTOSELF, -ENOTENOUGHSPACE
+   * Failure modes: either parent does not exist or isn't a directory,
+   * srcName does not exist, a name is invalid, the destination exists
+   * with a different type or is a non-empty directory, or a directory
+   * would move below itself.
+   */
+  int rename(int srcParentInodeNumber, std::string srcName,
+	     int dstParentInodeNumber, std::string dstName);
+
+  /**
+   * Copy a file.
+   *
+   * Makes dstName in directory dstParentInodeNumber a copy of the regular
+   * file srcInodeNumber, replacing the contents of an existing file. The
+   * copy shares the source's data blocks, the first write to either side
+   * gives it private blocks. Images without a refcount region get a
+   * plain copy of the data.
+   *
+   * Success: the inode number of the copy
+   * Failure: -EINVALIDINODE, -EINVALIDTYPE, -EINVALIDNAME, -ENOTENOUGHSPACE
+   * Failure modes: srcInodeNumber does not exist or isn't a regular file,
+   * dstParentInodeNumber isn't a directory, dstName is invalid or names a
+   * directory, or there is no space for the copy.
+   */
+  int clone(int srcInodeNumber, int dstParentInodeNumber, std::string dstName);
+
+  /**
+   * Take a snapshot.
+   *
+   * Freezes the current inode bitmap and inode region. The blocks they
+   * reference are shared with the live file system, which copies a block
+   * before its first change. Only metadata is written, so this is fast
+   * no matter how much data the image holds.
+   *
+   * Success: the id of the new snapshot
+   * Failure: -ENOTSUPPORTED, -ENOTENOUGHSPACE
+   * Failure modes: the image has no refcount region, or there is no room
+   * for the copies or another snapshot.
+   */
+  int snapshot();
+
+  /**
+   * Delete a snapshot, releasing the blocks only it still uses.
+   *
+   * Success: 0
+   * Failure: -ENOTFOUND
+   */
+  int deleteSnapshot(int id);
+
+  // the snapshots the image holds, oldest first
+  std::vector<snapshot_ent_t> snapshots();
+
+  /**
+   * A read-only view of a snapshot, NULL if there is no snapshot id.
+   * lookup, stat and read see the file system as it was when the
+   * snapshot was taken, anything that writes returns -EREADONLY. The
+   * caller deletes the view, it shares this file system's disk.
+   */
+  LocalFileSystem *openSnapshot(int id);
+
+  /**
+   * The number of data blocks behind an inode, fewer than its size needs
+   * when the file is stored compressed.
+   *
+   * Success: the number of blocks in use from inode_t.direct
+   * Failure: -EINVALIDINODE
+   */
+  int storedBlocks(int inodeNumber);
+
+  /**
+   * Move the blocks of a fragmented file into one contiguous run of free
+   * blocks. Files whose blocks are shared with copies or snapshots stay
+   * where they are, as do files that are already contiguous or that no
+   * free run fits.
+   *
+   * Success: the number of blocks moved, 0 when nothing moved
+   * Failure: -EINVALIDINODE, -ENOTALLOCATED, -EINVALIDTYPE, -EREADONLY
+   */
+  int relocate(int inodeNumber);
+
+  /**
+   * Grow the image to hold numInodes inodes and numData data blocks.
+   * The file gets longer and the regions take the places mkfs would give
+   * them. Data blocks the larger bitmaps and inode table now cover move
+   * to free blocks, every other block keeps its address.
+   *
+   * Success: the number of data blocks that moved
+   * Failure: -EINVALIDSIZE, -EREADONLY
+   * Failure modes: a size is smaller than it is now, or larger than
+   * RESIZE_MAX_INODES or RESIZE_MAX_DATA_BLOCKS.
+   */
+  int resize(int numInodes, int numData);
   
   /**
    * Some helper functions that you need to implement and use in your
@@ -134,6 +269,7 @@ class LocalFileSystem {
    * of trying to identify individual disk blocks and accessing only these.
    */
   void readSuperBlock(super_t *super);
+  void writeSuperBlock(super_t *super);
 
   // Helper functions, you should read/write the entire inode and bitmap regions
   void readInodeBitmap(super_t *super, unsigned char *inodeBitmap);
@@ -142,11 +278,60 @@ class LocalFileSystem {
   void writeDataBitmap(super_t *super, unsigned char *dataBitmap);
   void readInodeRegion(super_t *super, inode_t *inodes);
   void writeInodeRegion(super_t *super, inode_t *inodes);
+  void readRefcounts(super_t *super, refcount_t *refcounts);
+  void writeRefcounts(super_t *super, refcount_t *refcounts);
+
+  // The blocks of inode->direct in use, none for inline contents and fewer
+  // than the size needs for compressed ones
+  static int blocksOf(const inode_t *inode);
+
+  // Read or write a single inode, touching only the block that holds it
+  void readInode(super_t *super, int inodeNumber, inode_t *inode);
+  void writeInode(super_t *super, int inodeNumber, inode_t *inode);
+
+  // Data block allocation, aware of blocks shared through the refcount region.
+  // Block numbers are absolute, like the ones in inode_t.direct.
+  int allocateDataBlock(super_t *super, unsigned char *dataBitmap);
+  // Up to count blocks for one file, in a single run when there is one,
+  // right after goal if possible. Returns how many were found.
+  int allocateDataBlocks(super_t *super, unsigned char *dataBitmap, int count, int goal,
+			 std::vector<int> *blocks);
+  // the data index of the first run of count free blocks, or -1
+  int freeRun(super_t *super, unsigned char *dataBitmap, int count);
+  void releaseDataBlock(super_t *super, unsigned char *dataBitmap, int blockNumber);
+  int references(super_t *super, int blockNumber);
+  void setReferences(super_t *super, int blockNumber, int references);
+  int writeInodeBlock(super_t *super, inode_t *inode, int index, const void *buffer,
+		      unsigned char *dataBitmap);
+
+  // The fingerprint index of images made with mkfs -D
+  int findDuplicate(super_t *super, unsigned char *dataBitmap, uint64_t hash,
+		    const unsigned char *contents);
+  fingerprint_t readFingerprint(super_t *super, uint64_t hash);
+  void recordFingerprint(super_t *super, uint64_t hash, int blockNumber);
+  void forgetFingerprint(super_t *super, int blockNumber);
+
+  // Add or remove a single directory entry, writing only the blocks that change
+  int addEntry(super_t *super, int parentInodeNumber, std::string name, int inodeNumber);
+  int removeEntry(super_t *super, int parentInodeNumber, std::string name);
+  int addInlineEntry(super_t *super, inode_t *inode, const dir_ent_t *entry,
+		     unsigned char *dataBitmap);
 
   // Normally we'd mark this as private but we expose it so that you can access
   // it in a function you add that is not part of the LocalFileSystem object but
   // can still access the disk.
   Disk *disk;
+
+ private:
+  // set in snapshot views: where the frozen inode region lives
+  std::vector<int> snapshotInodeBlocks;
+  bool compression;
+
+  int compressedSize(const void *buffer, int size, std::vector<unsigned char> *compressed);
+  void relocatedBlocks(inode_t *inode, const std::map<int, int> &moved);
+  void writeTable(int addr, int len, const unsigned char *table, int freshBlocks);
+  bool inodeBlockInitialized(super_t *super, int regionBlock);
+  void initializeInodeBlocks(super_t *super, int regionBlock);
 };  
 
 #endif
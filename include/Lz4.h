@@ -0,0 +1,17 @@
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+// The LZ4 block format: a byte-aligned LZ77 codec that is fast enough to
+// sit in the read and write path. Used to store compressible files in
+// fewer data blocks.
+class Lz4 {
+public:
+  // compress src into dst, returns the compressed size or -1 when it
+  // doesn't fit in dstCapacity bytes
+  static int compress(const unsigned char *src, int srcSize, unsigned char *dst, int dstCapacity);
+
+  // decompress exactly dstSize bytes, returns -1 for corrupt input
+  static int decompress(const unsigned char *src, int srcSize, unsigned char *dst, int dstSize);
+};
+
+#endif
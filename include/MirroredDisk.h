@@ -0,0 +1,102 @@
+#ifndef _MIRRORED_DISK_H_
+#define _MIRRORED_DISK_H_
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "Disk.h"
+
+// blocks the rebuild copies at a time, writes wait for at most one batch
+#define MIRROR_REBUILD_BLOCKS (256)
+// how long writes must pause before the mirrors are marked clean
+#define MIRROR_CLEAN_MS (1000)
+
+// next to each mirror, one byte saying whether writes may be in flight
+#define MIRROR_STATE_SUFFIX ".state"
+#define MIRROR_CLEAN ('c')
+#define MIRROR_DIRTY ('d')
+
+/**
+ * A Disk kept in full on every one of several image files, RAID-1 style.
+ * Writes go to all mirrors in parallel. Each read goes to the mirror with
+ * the fewest blocks in flight, and a batch is split run by run over the
+ * mirrors, so mirrors on separate devices add up their read rates.
+ *
+ * The reference is the largest mirror whose superblock describes a valid
+ * image, and without one the disk refuses to start. A mirror that is
+ * missing, or that differs from the reference in size or superblock, was
+ * replaced. It is brought up to date by a background thread, and until
+ * then it only serves reads of blocks the rebuild has already copied.
+ *
+ * A crash between the writes to each mirror leaves mirrors that agree on
+ * size and superblock but not on every data block. So each mirror has a
+ * state file, marked dirty before the first write and clean once writes
+ * pause and every mirror is synced. A dirty or missing state file at
+ * startup rebuilds every mirror from the reference.
+ */
+class MirroredDisk : public Disk {
+ public:
+  MirroredDisk(std::vector<std::string> mirrorFiles, int blockSize);
+  virtual ~MirroredDisk();
+
+ protected:
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+  virtual void extend(off_t size);
+
+ private:
+  // one mirror's share of a batch: (slot in the buffer, block number)
+  struct MirrorTransfer {
+    MirroredDisk *disk;
+    int mirror;
+    bool write;
+    std::vector<std::pair<int, int> > blocks;
+    unsigned char *buffer;
+  };
+
+  std::vector<std::string> mirrorFiles;
+  std::vector<int> fds;
+  std::vector<int> stateFds;
+  // the mirror stale ones are rebuilt from
+  int reference;
+
+  // Guards inFlight and rebuilt. The blocks below rebuilt are current on
+  // every mirror, stale mirrors only serve those.
+  pthread_mutex_t stateLock;
+  std::vector<int> inFlight;
+  std::vector<bool> stale;
+  int rebuilt;
+  int rebuildEnd;
+  // reads that tie on depth take turns starting from here
+  int nextMirror;
+  bool stopping;
+  bool rebuilding;
+  pthread_t rebuilder;
+  // held by writes and by each rebuild copy, so a copy never puts back
+  // contents a write has replaced
+  pthread_mutex_t writeLock;
+  // guarded by writeLock: whether the state files say dirty, and a count
+  // of writes so the cleaner sees when they pause
+  bool dirty;
+  unsigned long writes;
+  pthread_t cleaner;
+  // signalled under stateLock when stopping is set
+  pthread_cond_t stopped;
+
+  int pickMirror(int firstBlock, int count);
+  void finished(int mirror, int count);
+  void transfer(std::vector<struct MirrorTransfer> &shares);
+  static void *transferMirror(void *arg);
+  static void *rebuild(void *arg);
+  bool inSync();
+  void markState(char state);
+  void startWrite();
+  static void *clean(void *arg);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _MMAP_DISK_H_
+#define _MMAP_DISK_H_
+
+#include <string>
+#include <vector>
+
+#include "Disk.h"
+
+/**
+ * A Disk that maps the whole image into memory. Reads are a memcpy out
+ * of the page cache without a system call, writes a memcpy into it.
+ * Commits msync the pages written since the last sync, so they are as
+ * durable as the file backend's fsync.
+ */
+class MmapDisk : public Disk {
+ public:
+  MmapDisk(std::string imageFile, int blockSize);
+  virtual ~MmapDisk();
+
+  virtual void grow(int numberOfBlocks);
+
+ protected:
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+
+ private:
+  int fd;
+  unsigned char *image;
+  // the blocks written since the last sync, firstDirty > lastDirty when none
+  int firstDirty;
+  int lastDirty;
+
+  void map();
+};
+
+#endif
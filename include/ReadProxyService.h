@@ -0,0 +1,55 @@
+#ifndef _READ_PROXY_SERVICE_H_
+#define _READ_PROXY_SERVICE_H_
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "HttpService.h"
+#include "ReplicaSet.h"
+
+// number of recent latencies used to pick the hedge delay
+#define HEDGE_LATENCY_SAMPLES (256)
+// below this many samples the initial delay is used
+#define HEDGE_MIN_SAMPLES (16)
+
+/**
+ * A read proxy in front of gunrock_web nodes that serve identical images.
+ *
+ * Every GET goes to one peer; if it has not answered after the hedge
+ * delay, the same GET goes to the next peer and whichever answers first
+ * wins while the other request is cancelled. The hedge delay tracks a
+ * percentile of recently observed latencies, so only the slow tail of
+ * requests is duplicated. GET /ds3/?stats=hedge reports the counters.
+ */
+class ReadProxyService : public HttpService {
+ public:
+  ReadProxyService(std::vector<std::string> peers, int percentile, int initialDelayMs, int timeoutMs);
+
+  virtual void get(HTTPRequest *request, HTTPResponse *response);
+
+ private:
+  int hedgeDelayMs();
+  void recordLatency(int latencyMs);
+  std::string stats();
+
+  std::vector<std::string> m_peers;
+  int m_percentile;
+  int m_initialDelayMs;
+  int m_timeoutMs;
+
+  pthread_mutex_t m_lock;
+  unsigned int m_nextPeer;
+  int m_latencies[HEDGE_LATENCY_SAMPLES];
+  int m_numLatencies;
+  int m_nextLatency;
+
+  // counters for tuning the percentile
+  unsigned long m_requests;
+  unsigned long m_hedged;
+  unsigned long m_hedgeWins;
+  unsigned long m_failures;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef _REPLICA_SET_H_
+#define _REPLICA_SET_H_
+
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HttpClient.h"
+
+// headers used between gunrock_web replicas
+#define REPLICA_HEADER "X-Ds3-Replica"
+#define VERSION_HEADER "X-Version"
+#define CONSISTENCY_HEADER "X-Consistency"
+
+/**
+ * The answer from one peer. status is 0 when the peer could not be
+ * reached or the request was cancelled.
+ */
+struct ReplicaResponse {
+  std::string peer;
+  int status;
+  std::string body;
+  std::string version;
+};
+
+/**
+ * A group of requests that run in parallel, one thread per peer.
+ *
+ * The caller starts requests, waits until enough of them have answered
+ * and then walks away with release(); stragglers finish in the background
+ * and the group frees itself once the last thread is done with it.
+ */
+class ReplicaRequestGroup {
+ public:
+  ReplicaRequestGroup();
+
+  void start(std::string peer, std::string method, std::string path,
+	     std::string body, std::map<std::string, std::string> headers);
+
+  /**
+   * Block until `needed` requests have answered with anything but a 5xx
+   * (or succeeded, when successOnly is set), every request has finished,
+   * or timeoutMs milliseconds have passed.
+   *
+   * @return true if the requested number of answers arrived
+   */
+  bool waitFor(int needed, bool successOnly, int timeoutMs);
+
+  // snapshot of the answers that have arrived so far, in arrival order
+  std::vector<ReplicaResponse> responses();
+
+  // abort every request still in flight, their answers are dropped
+  void cancel();
+
+  // drop the callers reference, the group must not be used afterwards
+  void release();
+
+ private:
+  struct Call {
+    ReplicaRequestGroup *group;
+    std::string peer;
+    std::string method;
+    std::string path;
+    std::string body;
+    std::map<std::string, std::string> headers;
+  };
+
+  ~ReplicaRequestGroup();
+  static void *run(void *arg);
+  bool track(HttpClient *client);
+  void untrack(HttpClient *client);
+  void finish(ReplicaResponse response);
+  void unref();
+
+  pthread_mutex_t m_lock;
+  pthread_cond_t m_answered;
+  int m_refs;
+  int m_started;
+  int m_finished;
+  int m_succeeded;
+  // answers other than 5xx, which only say the peer could not answer
+  int m_usable;
+  bool m_cancelled;
+  std::vector<HttpClient *> m_clients;
+  std::vector<ReplicaResponse> m_responses;
+};
+
+/**
+ * The peers of a replicated gunrock_web node, each given as host:port.
+ */
+class ReplicaSet {
+ public:
+  ReplicaSet(std::vector<std::string> peers, int timeoutMs);
+
+  std::vector<std::string> peers() { return m_peers; }
+  int timeoutMs() { return m_timeoutMs; }
+
+  /**
+   * Send the same request to every peer in parallel and return as soon as
+   * `needed` of them have answered with anything but a 5xx (or succeeded
+   * if successOnly is set).
+   * Requests still in flight are left to finish in the background.
+   */
+  std::vector<ReplicaResponse> fanOut(std::string method, std::string path, std::string body,
+				      std::map<std::string, std::string> headers,
+				      int needed, bool successOnly);
+
+  // fire and forget a single request, used for read repair
+  void sendAsync(std::string peer, std::string method, std::string path,
+		 std::string body, std::map<std::string, std::string> headers);
+
+  // split "host:port" into its parts
+  static bool parsePeer(std::string peer, std::string *host, int *port);
+
+ private:
+  std::vector<std::string> m_peers;
+  int m_timeoutMs;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _RESIZE_SERVICE_H_
+#define _RESIZE_SERVICE_H_
+
+#include "DistributedFileSystemService.h"
+#include "HttpService.h"
+
+/**
+ * Grows the image served by a ds3 service without stopping it.
+ *
+ *   GET  /ds3-resize/  "<inodes>\t<data blocks>", the current sizes
+ *   POST /ds3-resize/  grow to the form encoded inodes= and data= sizes,
+ *                      a size left out stays as it is
+ *
+ * The resize is one transaction under the file system lock, so requests
+ * wait for it and see the old or the new image, never a mix. Each
+ * replica's image is resized on its own.
+ */
+class ResizeService : public HttpService {
+ public:
+  ResizeService(DistributedFileSystemService *ds3);
+
+  virtual void get(HTTPRequest *request, HTTPResponse *response);
+  virtual void post(HTTPRequest *request, HTTPResponse *response);
+
+ private:
+  DistributedFileSystemService *m_ds3;
+};
+
+#endif
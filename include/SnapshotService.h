@@ -0,0 +1,34 @@
+#ifndef _SNAPSHOT_SERVICE_H_
+#define _SNAPSHOT_SERVICE_H_
+
+#include <string>
+
+#include "DistributedFileSystemService.h"
+#include "HttpService.h"
+
+/**
+ * Point-in-time snapshots of the image served by a ds3 service.
+ *
+ *   POST   /ds3-snap/             take a snapshot, the body is its id
+ *   GET    /ds3-snap/             list "<id>\t<created>" lines
+ *   GET    /ds3-snap/<id>/<path>  read a file or directory as it was
+ *   DELETE /ds3-snap/<id>         drop the snapshot
+ *
+ * Taking a snapshot only copies the inode table, so it holds the file
+ * system lock for milliseconds and writes carry on right after.
+ */
+class SnapshotService : public HttpService {
+ public:
+  SnapshotService(DistributedFileSystemService *ds3);
+
+  virtual void get(HTTPRequest *request, HTTPResponse *response);
+  virtual void post(HTTPRequest *request, HTTPResponse *response);
+  virtual void del(HTTPRequest *request, HTTPResponse *response);
+
+ private:
+  int snapshotId(std::string component);
+
+  DistributedFileSystemService *m_ds3;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _STRIPED_DISK_H_
+#define _STRIPED_DISK_H_
+
+#include <string>
+#include <vector>
+
+#include "Disk.h"
+
+// blocks in a stripe unit when gunrock and ds3stripe aren't told otherwise
+#define STRIPE_BLOCKS (16)
+
+/**
+ * A Disk whose blocks are spread over several image files, RAID-0 style.
+ * The image is cut into stripe units of stripeBlocks blocks, unit k goes
+ * to part k % parts. A run of adjacent blocks longer than a unit
+ * touches several parts, and batches move each part's share on its own
+ * thread, so the devices holding the parts work at the same time.
+ *
+ * A part holds every block that maps to it and nothing else, so parts
+ * only differ in size in the last, partial stripe. ds3stripe cuts an
+ * image into parts and joins them back.
+ */
+class StripedDisk : public Disk {
+ public:
+  StripedDisk(std::vector<std::string> partFiles, int blockSize, int stripeBlocks = STRIPE_BLOCKS);
+  virtual ~StripedDisk();
+
+  // the size of part in blocks, for an image of imageBlocks blocks
+  static int partBlocks(int part, int parts, int stripeBlocks, int imageBlocks);
+
+ protected:
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+  virtual void extend(off_t size);
+
+ private:
+  // one part's share of a batch: (slot in the buffer, block in the part)
+  struct PartTransfer {
+    StripedDisk *disk;
+    int part;
+    bool write;
+    std::vector<std::pair<int, int> > blocks;
+    unsigned char *buffer;
+  };
+
+  std::vector<std::string> partFiles;
+  std::vector<int> fds;
+  int stripeBlocks;
+
+  int partOf(int blockNumber);
+  int partBlock(int blockNumber);
+  void transfer(bool write, const std::vector<int> &blockNumbers, unsigned char *buffer);
+  static void *transferPart(void *arg);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _URING_DISK_H_
+#define _URING_DISK_H_
+
+#include <string>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "Disk.h"
+
+// submission queue entries, the most reads one io_uring_enter hands over
+#define URING_ENTRIES (64)
+
+/**
+ * A Disk that serves batched reads through io_uring: readBlocks queues a
+ * read for every run of adjacent blocks and submits them with one system
+ * call, so the kernel works on all of them at once. Single block reads and writes use
+ * pread and pwrite on a descriptor held open.
+ *
+ * The rings are driven with raw system calls, there is no liburing. When
+ * the kernel refuses io_uring_setup (too old, or blocked by a seccomp
+ * policy) batches fall back to one pread per block.
+ */
+class UringDisk : public Disk {
+ public:
+  UringDisk(std::string imageFile, int blockSize);
+  virtual ~UringDisk();
+
+ protected:
+  virtual void readRaw(int blockNumber, void *buffer);
+  virtual void writeRaw(int blockNumber, const void *buffer);
+  virtual void readRawBlocks(const std::vector<int> &blockNumbers, unsigned char *buffer);
+  virtual void writeRawBlocks(const std::vector<int> &blockNumbers, const unsigned char *buffer);
+  virtual void sync();
+
+ private:
+  int fd;
+  int ringFd;
+
+  void *sqRing;
+  size_t sqRingSize;
+  void *cqRing;
+  size_t cqRingSize;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+
+  unsigned *sqTail;
+  unsigned sqMask;
+  unsigned sqEntries;
+  unsigned *sqArray;
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned cqMask;
+  struct io_uring_cqe *cqes;
+
+  bool setupRing();
+  int enter(unsigned toSubmit, unsigned minComplete);
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _VERSION_VECTOR_H_
+#define _VERSION_VECTOR_H_
+
+#include <map>
+#include <string>
+
+/**
+ * A per-file version vector for the replicated ds3 mode.
+ *
+ * Each replica that coordinates a write bumps its own counter, so two
+ * vectors can be compared to tell whether one copy of a file strictly
+ * supersedes another or whether the two were written concurrently.
+ * Vectors travel between replicas in the X-Version header using the
+ * form "nodeA=3,nodeB=1".
+ */
+class VersionVector {
+ public:
+  typedef enum {EQUAL, BEFORE, AFTER, CONCURRENT} Ordering;
+
+  VersionVector();
+
+  static VersionVector parse(std::string encoded);
+  std::string toString() const;
+
+  // bump the counter that belongs to nodeId
+  void increment(std::string nodeId);
+  // take the element-wise maximum of both vectors
+  void merge(const VersionVector &other);
+  bool empty() const { return m_counters.empty(); }
+
+  // how this vector orders relative to other
+  Ordering compare(const VersionVector &other) const;
+
+  // true if this copy should win over other when picking the newest
+  // replica. Concurrent versions are broken deterministically so that
+  // every coordinator picks the same winner.
+  bool newerThan(const VersionVector &other) const;
+
+ private:
+  unsigned long total() const;
+
+  std::map<std::string, unsigned long> m_counters;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _XX_HASH_64_H_
+#define _XX_HASH_64_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH64 from the xxHash family: a fast non-cryptographic hash, used to
+// fingerprint data blocks. Matches need checking against the data.
+class XxHash64 {
+public:
+  static uint64_t hash(const void *data, size_t len, uint64_t seed = 0);
+};
+
+#endif
@@ -12,6 +12,8 @@ int dthread_mutex_lock(pthread_mutex_t *mutex);
 int dthread_mutex_unlock(pthread_mutex_t *mutex);
 
 int dthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int dthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+			   const struct timespec *abstime);
 int dthread_cond_signal(pthread_cond_t *cond);
 int dthread_cond_broadcast(pthread_cond_t *cond);
 
@@ -4,6 +4,15 @@
 #define UFS_DIRECTORY (0)
 #define UFS_REGULAR_FILE (1)
 
+// The high bits of inode_t.type carry per-file flags, stat() only reports
+// the type itself.
+#define UFS_TYPE_MASK (0xff)
+// Contents are stored Lz4 compressed, and in fewer blocks than their size
+// needs. direct[DIRECT_PTRS - 1] holds the compressed byte count.
+#define UFS_FLAG_COMPRESSED (0x100)
+// Contents live in the direct[] array itself, there are no data blocks.
+#define UFS_FLAG_INLINE (0x200)
+
 #define UFS_ROOT_DIRECTORY_INODE_NUMBER (0)
 
 #define UFS_BLOCK_SIZE (4096)
@@ -12,6 +21,9 @@
 
 #define MAX_FILE_SIZE (DIRECT_PTRS * UFS_BLOCK_SIZE)
 
+// files and directories this small are stored inline in their inode
+#define UFS_INLINE_SIZE (DIRECT_PTRS * sizeof(unsigned int))
+
 // Note: Bitmap indexes identify disk blocks relative to the start of a region.
 
 typedef struct {
@@ -38,7 +50,58 @@ typedef struct __super {
     int data_region_len;   // in blocks
     int num_inodes;        // just the number of inodes
     int num_data;          // and data blocks...
+    // Optional regions live after the data region so older images keep
+    // their layout. An address of 0 means the image doesn't have one.
+    int refcount_addr;     // block address (in blocks)
+    int refcount_len;      // in blocks
+    int snapshot_addr;     // block address of the snapshot index, 0 until the first snapshot
+    int fingerprint_addr;  // block address (in blocks), images made with mkfs -D
+    int fingerprint_len;   // in blocks
+    int checksum_addr;     // block address (in blocks), images made with mkfs -C
+    int checksum_len;      // in blocks
+    int inode_init_len;    // inode region blocks written so far, the rest read as zeroed
+                           // inodes. 0 in images made before mkfs left them unwritten.
 } super_t;
 
+// One entry per data block: how many inodes share the block beyond the
+// first. Copies share blocks until one of them is written.
+typedef unsigned short refcount_t;
+#define UFS_REFCOUNT_MAX (65535)
+
+// A snapshot is a frozen copy of the inode bitmap and inode region kept in
+// data blocks. Every block its inodes use gets one more reference, so the
+// live file system copies a block before changing it.
+// The fingerprint region maps block contents to a block that holds them,
+// direct-mapped by hash. A slot only hints at a duplicate: writers check
+// the block is still allocated and compare its contents before sharing.
+typedef struct {
+    unsigned long long hash;  // XxHash64 of the block
+    int block;                // block address, 0 for an empty slot
+    int unused;
+} fingerprint_t;
+
+// The checksum region holds a CRC32C (uint32_t) for every block of the
+// image, 0 until the block is first written. Disk maintains it.
+
+typedef struct {
+    int inode_bitmap_len;  // blocks holds the inode bitmap copy first,
+    int inode_region_len;  // then the inode region copy
+    int blocks[UFS_BLOCK_SIZE / sizeof(int) - 2];
+} snapshot_header_t;
+
+typedef struct {
+    int id;                // 0 marks a free slot
+    int header;            // block address of the snapshot_header_t
+    long long created;     // seconds since the epoch
+} snapshot_ent_t;
+
+#define UFS_MAX_SNAPSHOTS ((UFS_BLOCK_SIZE - 4 * sizeof(int)) / sizeof(snapshot_ent_t))
+
+typedef struct {
+    int next_id;
+    int unused[3];
+    snapshot_ent_t entries[UFS_MAX_SNAPSHOTS];
+} snapshot_index_t;
+
 
 #endif // __ufs_h__
@@ -8,7 +8,9 @@
 #include "ufs.h"
 
 void usage() {
-    fprintf(stderr, "usage: mkfs -f <image_file> [-d <num_data_blocks] [-i <num_inodes>]\n");
+    fprintf(stderr, "usage: mkfs -f <image_file> [-d <num_data_blocks] [-i <num_inodes>] [-D] [-C]\n");
+    fprintf(stderr, "  -D  add a fingerprint index so identical blocks are stored once\n");
+    fprintf(stderr, "  -C  add a checksum table so corrupt blocks are noticed on read\n");
     exit(1);
 }
 
@@ -18,8 +20,10 @@ int main(int argc, char *argv[]) {
     int num_inodes = 32;
     int num_data = 32;
     int visual = 0;
+    int dedup = 0;
+    int checksums = 0;
 
-    while ((ch = getopt(argc, argv, "i:d:f:v")) != -1) {
+    while ((ch = getopt(argc, argv, "i:d:f:vDC")) != -1) {
 	switch (ch) {
 	case 'i':
 	    num_inodes = atoi(optarg);
@@ -33,6 +37,12 @@ int main(int argc, char *argv[]) {
 	case 'v':
 	    visual = 1;
 	    break;
+	case 'D':
+	    dedup = 1;
+	    break;
+	case 'C':
+	    checksums = 1;
+	    break;
 	default:
 	    usage();
 	}
@@ -43,13 +53,6 @@ int main(int argc, char *argv[]) {
     if (image_file == NULL)
 	usage();
 
-    unsigned char *empty_buffer;
-    empty_buffer = calloc(UFS_BLOCK_SIZE, 1);
-    if (empty_buffer == NULL) {
-	perror("calloc");
-	exit(1);
-    }
-
     int fd = open(image_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
     if (fd < 0) {
 	perror("open");
@@ -61,6 +64,7 @@ int main(int argc, char *argv[]) {
 
     // presumed: block 0 is the super block
     super_t s;
+    memset(&s, 0, sizeof(s));
 
     // totals
     s.num_inodes = num_inodes;
@@ -86,12 +90,42 @@ int main(int argc, char *argv[]) {
     s.inode_region_len = total_inode_bytes / UFS_BLOCK_SIZE;
     if (total_inode_bytes % UFS_BLOCK_SIZE != 0)
 	s.inode_region_len++;
+    // only the block with the root inode is written, the file system
+    // zeroes the others as they come into use
+    s.inode_init_len = 1;
 
     // data blocks
     s.data_region_addr = s.inode_region_addr + s.inode_region_len;
     s.data_region_len = num_data;
 
-    int total_blocks = 1 + s.inode_bitmap_len + s.data_bitmap_len + s.inode_region_len + s.data_region_len;
+    // shared block reference counts
+    s.refcount_addr = s.data_region_addr + s.data_region_len;
+    int total_refcount_bytes = num_data * sizeof(refcount_t);
+    s.refcount_len = total_refcount_bytes / UFS_BLOCK_SIZE;
+    if (total_refcount_bytes % UFS_BLOCK_SIZE != 0)
+	s.refcount_len++;
+
+    // fingerprint index, one slot per data block
+    if (dedup) {
+	s.fingerprint_addr = s.refcount_addr + s.refcount_len;
+	int total_fingerprint_bytes = num_data * sizeof(fingerprint_t);
+	s.fingerprint_len = total_fingerprint_bytes / UFS_BLOCK_SIZE;
+	if (total_fingerprint_bytes % UFS_BLOCK_SIZE != 0)
+	    s.fingerprint_len++;
+    }
+
+    int total_blocks = 1 + s.inode_bitmap_len + s.data_bitmap_len + s.inode_region_len + s.data_region_len
+	+ s.refcount_len + s.fingerprint_len;
+
+    // checksum table, one entry per block including its own, which sizes it
+    if (checksums) {
+	int entries_per_block = UFS_BLOCK_SIZE / sizeof(unsigned int);
+	s.checksum_addr = total_blocks;
+	s.checksum_len = 1;
+	while ((total_blocks + s.checksum_len) > s.checksum_len * entries_per_block)
+	    s.checksum_len++;
+	total_blocks += s.checksum_len;
+    }
 
     // super block is the first block
     int rc = pwrite(fd, &s, sizeof(super_t), 0);
@@ -106,17 +140,19 @@ int main(int argc, char *argv[]) {
     printf("layout details\n");
     printf("  inode bitmap address/len %d [%d]\n", s.inode_bitmap_addr, s.inode_bitmap_len);
     printf("  data bitmap address/len  %d [%d]\n", s.data_bitmap_addr, s.data_bitmap_len);
-
-    // first, zero out all the blocks
+    printf("  refcount address/len     %d [%d]\n", s.refcount_addr, s.refcount_len);
+    if (dedup)
+	printf("  fingerprint address/len  %d [%d]\n", s.fingerprint_addr, s.fingerprint_len);
+    if (checksums)
+	printf("  checksum address/len     %d [%d]\n", s.checksum_addr, s.checksum_len);
+
+    // first, size the image: the blocks read as zeroes without being
+    // written, so formatting takes the same time for any capacity
     int i;
-    for (i = 1; i < total_blocks; i++) {
-        rc = pwrite(fd, empty_buffer, UFS_BLOCK_SIZE, i * UFS_BLOCK_SIZE);
-        if (rc != UFS_BLOCK_SIZE) {
-            perror("write");
-            exit(1);
-        }
+    if (ftruncate(fd, (off_t) total_blocks * UFS_BLOCK_SIZE) != 0) {
+	perror("ftruncate");
+	exit(1);
     }
-    free(empty_buffer);
 
     //
     // need to allocate first inode in inode bitmap
@@ -149,6 +185,7 @@ int main(int argc, char *argv[]) {
     } inode_block;
 
     inode_block itable;
+    memset(&itable, 0, sizeof(itable));
     itable.inodes[0].type = UFS_DIRECTORY;
     itable.inodes[0].size = 2 * sizeof(dir_ent_t); // in bytes
     itable.inodes[0].direct[0] = s.data_region_addr;
@@ -193,6 +230,12 @@ int main(int argc, char *argv[]) {
 	    printf("I");
 	for (i = 0; i < s.data_region_len; i++)
 	    printf("D");
+	for (i = 0; i < s.refcount_len; i++)
+	    printf("r");
+	for (i = 0; i < s.fingerprint_len; i++)
+	    printf("f");
+	for (i = 0; i < s.checksum_len; i++)
+	    printf("c");
 	printf("\n\n");
     }
 
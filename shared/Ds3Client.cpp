@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include <sstream>
+
+#include "Ds3Client.h"
+#include "HttpClient.h"
+#include "StringUtils.h"
+
+using namespace std;
+
+Ds3Client::Ds3Client(string host, int port, int pollIntervalMs) {
+  m_host = host;
+  m_port = port;
+  m_pollIntervalMs = pollIntervalMs;
+  m_haveSequence = false;
+  m_sequence = 0;
+  m_lastPoll = 0;
+  m_hits = 0;
+  m_misses = 0;
+}
+
+int Ds3Client::get(string path, string *body) {
+  string cacheKey = key(path);
+  long long now = nowMs();
+
+  if (m_cache.size() > 0 && now - m_lastPoll >= m_pollIntervalMs) {
+    refresh();
+  }
+
+  map<string, struct CacheEntry>::iterator entry = m_cache.find(cacheKey);
+  if (entry != m_cache.end() && entry->second.expires > now) {
+    m_hits++;
+    *body = entry->second.body;
+    return 200;
+  }
+  m_misses++;
+
+  HTTPClientResponse *response = request("GET", path, "");
+  int status = response->status();
+  if (status == 200) {
+    *body = response->body();
+
+    // X-Lease: ttl=<ms>; seq=<revocation sequence when granted>
+    string lease = response->header("X-Lease");
+    size_t ttl = lease.find("ttl=");
+    size_t seq = lease.find("seq=");
+    if (ttl != string::npos && seq != string::npos) {
+      struct CacheEntry cached;
+      cached.body = *body;
+      // time the lease from when we sent the request
+      cached.expires = now + atol(lease.substr(ttl + 4).c_str());
+      m_cache[cacheKey] = cached;
+
+      if (!m_haveSequence) {
+	m_haveSequence = true;
+	m_sequence = strtoul(lease.substr(seq + 4).c_str(), NULL, 10);
+	m_lastPoll = now;
+      }
+    }
+  }
+  delete response;
+
+  return status;
+}
+
+int Ds3Client::put(string path, string body) {
+  HTTPClientResponse *response = request("PUT", path, body);
+  int status = response->status();
+  delete response;
+
+  forget(key(path));
+  return status;
+}
+
+int Ds3Client::del(string path) {
+  HTTPClientResponse *response = request("DELETE", path, "");
+  int status = response->status();
+  delete response;
+
+  forget(key(path));
+  return status;
+}
+
+int Ds3Client::move(string path, string destination) {
+  while (destination.size() > 0 && destination[0] == '/') {
+    destination.erase(0, 1);
+  }
+
+  HttpClient client(m_host.c_str(), m_port);
+  client.set_header("Destination", "/ds3/" + destination);
+  client.write_request("/ds3/" + key(path), "MOVE", "");
+  HTTPClientResponse *response = client.read_response();
+  int status = response->status();
+  delete response;
+
+  forget(key(path), true);
+  forget(key(destination), true);
+  return status;
+}
+
+void Ds3Client::refresh() {
+  m_lastPoll = nowMs();
+  if (!m_haveSequence) {
+    return;
+  }
+
+  stringstream query;
+  query << "?invalidations=" << m_sequence;
+  HTTPClientResponse *response = request("GET", query.str(), "");
+  int status = response->status();
+  string body = response->body();
+  delete response;
+
+  if (status != 200 && status != 205) {
+    // can't tell what changed, so trust nothing
+    m_cache.clear();
+    return;
+  }
+
+  vector<string> lines = StringUtils::split(body, '\n');
+  if (lines.size() == 0) {
+    return;
+  }
+  m_sequence = strtoul(lines[0].c_str(), NULL, 10);
+
+  if (status == 205) {
+    // we polled too late for the server to know what changed
+    m_cache.clear();
+    return;
+  }
+  for (size_t idx = 1; idx < lines.size(); idx++) {
+    m_cache.erase(lines[idx]);
+  }
+}
+
+HTTPClientResponse *Ds3Client::request(string method, string path, string body) {
+  while (path.size() > 0 && path[0] == '/') {
+    path.erase(0, 1);
+  }
+
+  HttpClient client(m_host.c_str(), m_port);
+  client.write_request("/ds3/" + path, method, body);
+  return client.read_response();
+}
+
+// a change to a path also changes the listings of the directories above it
+void Ds3Client::forget(string key, bool subtree) {
+  if (subtree) {
+    string prefix = key + "/";
+    map<string, struct CacheEntry>::iterator entry = m_cache.lower_bound(prefix);
+    while (entry != m_cache.end() && entry->first.compare(0, prefix.size(), prefix) == 0) {
+      m_cache.erase(entry++);
+    }
+  }
+  while (true) {
+    m_cache.erase(key);
+    if (key == "") {
+      break;
+    }
+    size_t slash = key.find_last_of('/');
+    key = (slash == string::npos) ? "" : key.substr(0, slash);
+  }
+}
+
+// cache entries use the same path form as the server's leases
+string Ds3Client::key(string path) {
+  vector<string> tokens = StringUtils::split(path, '/');
+  string result;
+  for (size_t idx = 0; idx < tokens.size(); idx++) {
+    if (idx > 0) {
+      result += "/";
+    }
+    result += tokens[idx];
+  }
+  return result;
+}
+
+long long Ds3Client::nowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
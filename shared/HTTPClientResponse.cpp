@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <strings.h>
 
 #include <sstream>
 
@@ -45,8 +46,33 @@ string HTTPClientResponse::readResponse() {
       stringstream header_line(line);
       string http;
       header_line >> http >> m_status_code >> m_status_message;
+    } else {
+      size_t colon = line.find(':');
+      if (colon == string::npos) {
+        continue;
+      }
+      string key = line.substr(0, colon);
+      string value = line.substr(colon + 1);
+      // trim the leading space and trailing carriage return
+      while (value.size() > 0 && value[0] == ' ') {
+        value.erase(0, 1);
+      }
+      if (value.size() > 0 && value[value.size() - 1] == '\r') {
+        value.erase(value.size() - 1);
+      }
+      m_headers[key] = value;
     }
   }
   
   return m_body;
 }
+
+string HTTPClientResponse::header(string key) {
+  map<string, string>::iterator iter;
+  for (iter = m_headers.begin(); iter != m_headers.end(); iter++) {
+    if (strcasecmp(iter->first.c_str(), key.c_str()) == 0) {
+      return iter->second;
+    }
+  }
+  return "";
+}
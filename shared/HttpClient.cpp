@@ -30,6 +30,10 @@ HttpClient::~HttpClient() {
   delete connection;
 }
 
+void HttpClient::cancel() {
+  connection->shutdown();
+}
+
 void HttpClient::set_header(string key, string value) {
   headers[key] = value;
 }
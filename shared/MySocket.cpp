@@ -102,3 +102,9 @@ void MySocket::close(void) {
 
     sockFd = -1;
 }
+
+void MySocket::shutdown(void) {
+    if(sockFd<0) return;
+
+    ::shutdown(sockFd, SHUT_RDWR);
+}
@@ -0,0 +1,87 @@
+#ifndef __DS3_CLIENT_H__
+#define __DS3_CLIENT_H__
+
+#include <map>
+#include <string>
+
+#include "HTTPClientResponse.h"
+
+class Ds3Client {
+ public:
+  /**
+   * Constructor.
+   *
+   * A client for the /ds3/ service that caches file contents and
+   * directory listings for as long as the server's read lease (X-Lease
+   * header) allows. Leases that the server revokes early because of a
+   * PUT or DELETE are picked up by polling the server's invalidation
+   * channel at most once every pollIntervalMs milliseconds.
+   *
+   * @param host the ip address or domain name of the ds3 server
+   * @param port the port the server listens on
+   * @param pollIntervalMs how stale a revoked cache entry may get
+   */
+  Ds3Client(std::string host, int port, int pollIntervalMs = 1000);
+
+  /**
+   * Read a file or list a directory
+   *
+   * @param path the path below /ds3/, directories end in a slash
+   * @param body filled in with the contents on success
+   * @return the HTTP status code, 200 on success
+   */
+  int get(std::string path, std::string *body);
+
+  /**
+   * Create or overwrite a file, or create a directory
+   *
+   * @return the HTTP status code, 200 on success
+   */
+  int put(std::string path, std::string body);
+
+  /**
+   * Delete a file or an empty directory
+   *
+   * @return the HTTP status code, 200 on success
+   */
+  int del(std::string path);
+
+  /**
+   * Rename a file or directory on the server, without copying its data
+   *
+   * @return the HTTP status code, 200 on success
+   */
+  int move(std::string path, std::string destination);
+
+  /**
+   * Poll the invalidation channel right away and drop revoked entries.
+   */
+  void refresh();
+
+  unsigned long hits() { return m_hits; }
+  unsigned long misses() { return m_misses; }
+
+ private:
+  struct CacheEntry {
+    std::string body;
+    long long expires;
+  };
+
+  HTTPClientResponse *request(std::string method, std::string path, std::string body);
+  void forget(std::string key, bool subtree = false);
+  static std::string key(std::string path);
+  static long long nowMs();
+
+  std::string m_host;
+  int m_port;
+  int m_pollIntervalMs;
+
+  std::map<std::string, struct CacheEntry> m_cache;
+  bool m_haveSequence;
+  unsigned long m_sequence;
+  long long m_lastPoll;
+  unsigned long m_hits;
+  unsigned long m_misses;
+};
+
+#endif
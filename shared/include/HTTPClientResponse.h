@@ -13,6 +13,8 @@ class HTTPClientResponse {
   int status() { return m_status_code; }
   bool success() { return m_status_code >= 200 && m_status_code < 300; }
   std::string body() { return m_body; }
+  // returns the value of the header key (case insensitive), or "" if missing
+  std::string header(std::string key);
   
  protected:
   MySocket *m_sock;
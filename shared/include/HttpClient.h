@@ -96,6 +96,14 @@ class HttpClient {
   
   void write_request(std::string path, std::string method, std::string body);
   HTTPClientResponse *read_response();
+
+  /**
+   * Abort the request
+   *
+   * Safe to call from another thread while a request is in progress, the
+   * pending read_response will return early with whatever has arrived.
+   */
+  void cancel();
   
  private:
   MySocket *connection;
@@ -52,6 +52,8 @@ class MySocket {
   virtual std::string read();
   virtual void write(std::string data);
   virtual void close(void);
+  // stop any read or write in progress on another thread
+  virtual void shutdown(void);
   
  protected:
   void call_connect(const char *inetAddr, int port);
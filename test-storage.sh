@@ -0,0 +1,449 @@
+#! /bin/bash
+# Storage checks against live gunrock_web servers on scratch images, one
+# section per feature. Each section stops its servers and runs ds3fsck.
+# Run after make, from this directory. PORT picks the port (default 8180).
+
+PORT=${PORT:-8180}
+URL=http://localhost:$PORT
+WORK=$(mktemp -d)
+SERVERS=
+
+stop() {
+    for server in $SERVERS; do
+	kill $server 2> /dev/null
+	wait $server 2> /dev/null
+    done
+    SERVERS=
+}
+trap 'stop; rm -rf $WORK' EXIT
+
+fail() {
+    echo "Error: $*"
+    exit 1
+}
+
+# start a server on port $1 and image $2, with any extra options after them
+start_at() {
+    local port=$1
+    local image=$2
+    shift 2
+    ./gunrock_web -p $port -i $image "$@" > $WORK/server-$port.log 2>&1 &
+    SERVERS="$SERVERS $!"
+    for i in $(seq 50); do
+	curl -s -o /dev/null http://localhost:$port/ds3/ && return
+	sleep 0.1
+    done
+    cat $WORK/server-$port.log
+    fail "gunrock_web did not start on port $port"
+}
+
+# the same on PORT
+start() {
+    start_at $PORT "$@"
+}
+
+# data blocks in use on image $1, from the data bitmap ds3bits prints
+used_blocks() {
+    ./ds3bits $1 | awk '/^Data bitmap/ { getline; for (i = 1; i <= NF; i++) for (b = $i; b > 0; b = int(b / 2)) n += b % 2 } END { print n }'
+}
+
+# data blocks of file $2 in the root directory of image $1, one per line
+file_blocks() {
+    local inode=$(./ds3ls $1 / | awk -v name=$2 '$2 == name { print $1 }')
+    ./ds3cat $1 $inode | sed -n '/^File blocks$/,/^$/ { /^[0-9]/p }'
+}
+
+# whether the blocks of file $2 on image $1 are one run
+contiguous() {
+    file_blocks $1 $2 | awk 'NR > 1 && $1 != last + 1 { exit 1 } { last = $1 }'
+}
+
+put() {
+    curl -s -o /dev/null -w "%{http_code}" -X PUT --data-binary @$2 $URL/ds3/$1
+}
+
+# body of $2 must match file $1
+same() {
+    curl -s $2 > $WORK/got
+    cmp -s $1 $WORK/got
+}
+
+# PUT/GET round trips of compressible, incompressible and small files on
+# the server at URL, then each overwritten with another kind
+round_trips() {
+    [[ $(put text $WORK/text) == 200 ]] || fail "PUT of a compressible file"
+    [[ $(put random $WORK/random) == 200 ]] || fail "PUT of an incompressible file"
+    [[ $(put d/small $WORK/small) == 200 ]] || fail "PUT of a small file"
+    same $WORK/text $URL/ds3/text || fail "compressible file read back differently"
+    same $WORK/random $URL/ds3/random || fail "incompressible file read back differently"
+    same $WORK/small $URL/ds3/d/small || fail "small file read back differently"
+    [[ $(put text $WORK/random) == 200 ]] || fail "PUT over a compressible file"
+    [[ $(put random $WORK/text) == 200 ]] || fail "PUT over an incompressible file"
+    [[ $(put d/small $WORK/text) == 200 ]] || fail "PUT over a small file"
+    same $WORK/random $URL/ds3/text || fail "overwritten compressible file read back differently"
+    same $WORK/text $URL/ds3/random || fail "overwritten incompressible file read back differently"
+    same $WORK/text $URL/ds3/d/small || fail "overwritten small file read back differently"
+}
+
+for tool in mkfs gunrock_web ds3bits ds3cat ds3ls ds3fsck ds3stripe; do
+    if ! [[ -x $tool ]]; then
+	echo "$tool executable does not exist"
+	exit 1
+    fi
+done
+
+yes "the same line, over and over" | head -c 100000 > $WORK/text
+head -c 100000 /dev/urandom > $WORK/random
+head -c 100 /dev/urandom > $WORK/small
+
+echo "compressed round trips"
+./mkfs -f $WORK/z.img -d 512 -i 64 > /dev/null
+start $WORK/z.img -z
+before=$(used_blocks $WORK/z.img)
+[[ $(put text $WORK/text) == 200 ]] || fail "PUT of a compressible file"
+after=$(used_blocks $WORK/z.img)
+(( after - before < 25 )) || fail "a 100 KB compressible file took $((after - before)) blocks"
+round_trips
+stop
+./ds3fsck $WORK/z.img > /dev/null || fail "ds3fsck after the compressed round trips"
+
+echo "disk backends"
+for backend in file mmap uring direct; do
+    ./mkfs -f $WORK/$backend.img -d 256 -i 64 > /dev/null
+    start $WORK/$backend.img -D $backend
+    round_trips
+    stop
+    ./ds3fsck $WORK/$backend.img > /dev/null || fail "ds3fsck after round trips on -D $backend"
+done
+
+# two parts with small stripes, so every file spans both
+./mkfs -f $WORK/striped.img -d 256 -i 64 > /dev/null
+./ds3stripe -w 4 $WORK/striped.img $WORK/part0 $WORK/part1 > /dev/null || fail "ds3stripe"
+start $WORK/part0,$WORK/part1 -W 4
+round_trips
+stop
+./ds3stripe -j -w 4 $WORK/joined.img $WORK/part0 $WORK/part1 > /dev/null || fail "ds3stripe -j"
+./ds3fsck $WORK/joined.img > /dev/null || fail "ds3fsck after round trips on a striped image"
+
+echo "mirrors"
+# until the rebuild thread reports on mirror $1
+wait_rebuilt() {
+    for i in $(seq 50); do
+	grep -q "mirror $1 rebuilt" $WORK/server-$PORT.log && return
+	sleep 0.1
+    done
+    fail "mirror $1 was not rebuilt"
+}
+./mkfs -f $WORK/m0.img -d 256 -i 64 > /dev/null
+cp $WORK/m0.img $WORK/m1.img
+start $WORK/m0.img,$WORK/m1.img -D mirror
+round_trips
+# once writes pause the mirrors are marked clean, and a restart trusts them
+sleep 2
+[[ $(cat $WORK/m0.img.state $WORK/m1.img.state) == cc ]] || fail "mirrors not marked clean after writes paused"
+stop
+start $WORK/m0.img,$WORK/m1.img -D mirror
+grep -q resynchronising $WORK/server-$PORT.log && fail "cleanly stopped mirrors were resynchronised"
+# a crash right after a write, with a mirror that missed part of it
+[[ $(put crash $WORK/random) == 200 ]] || fail "PUT before the crash"
+{ kill -9 $SERVERS; wait $SERVERS; } 2> /dev/null
+SERVERS=
+[[ $(cat $WORK/m0.img.state) == d ]] || fail "mirrors not marked dirty during writes"
+dd if=/dev/urandom of=$WORK/m1.img bs=4096 seek=20 count=4 conv=notrunc 2> /dev/null
+start $WORK/m0.img,$WORK/m1.img -D mirror
+wait_rebuilt $WORK/m1.img
+stop
+cmp -s $WORK/m0.img $WORK/m1.img || fail "mirrors differ after resynchronising"
+# a replaced, empty first mirror is rebuilt from the second
+: > $WORK/m0.img
+start $WORK/m0.img,$WORK/m1.img -D mirror
+same $WORK/random $URL/ds3/crash || fail "file lost with the first mirror"
+wait_rebuilt $WORK/m0.img
+stop
+cmp -s $WORK/m0.img $WORK/m1.img || fail "mirrors differ after rebuilding"
+./ds3fsck $WORK/m0.img > /dev/null || fail "ds3fsck after the mirror checks"
+
+echo "batch failing midway"
+# too few inodes for the deep path below, which fails after creating
+# most of its directories
+./mkfs -f $WORK/b.img -d 256 -i 32 > /dev/null
+start $WORK/b.img
+[[ $(put keep $WORK/random) == 200 ]] || fail "PUT before the batch"
+deep=$(seq -s / 40)/file
+printf 'PUT %s 5\nfirst\n' $deep > $WORK/batch
+cp $WORK/b.img $WORK/before.img
+curl -s -X POST --data-binary @$WORK/batch $URL/ds3/ > $WORK/result
+grep -q "^507 " $WORK/result || fail "deep PUT in a batch: $(cat $WORK/result)"
+cmp -s $WORK/before.img $WORK/b.img || fail "a failed batch left blocks changed"
+printf 'PUT one 5\nfirst\nPUT %s 6\nsecond\nDELETE keep\n' $deep > $WORK/batch
+curl -s -X POST --data-binary @$WORK/batch $URL/ds3/ > $WORK/result
+[[ $(sed -n 1p $WORK/result) == "200 one" ]] || fail "first operation: $(cat $WORK/result)"
+[[ $(sed -n 2p $WORK/result) == "507 $deep" ]] || fail "failing operation: $(cat $WORK/result)"
+[[ $(sed -n 3p $WORK/result) == "200 keep" ]] || fail "last operation: $(cat $WORK/result)"
+[[ $(curl -s $URL/ds3/one) == first ]] || fail "operations before the failure were lost"
+[[ $(curl -s -o /dev/null -w "%{http_code}" $URL/ds3/1/) == 404 ]] || fail "the failed PUT left directories behind"
+stop
+./ds3fsck $WORK/b.img > /dev/null || fail "ds3fsck after the batches"
+
+echo "resize with a snapshot"
+./mkfs -f $WORK/r.img -d 128 -i 32 -D -C > /dev/null
+start $WORK/r.img
+[[ $(put a $WORK/random) == 200 ]] || fail "PUT before the snapshot"
+[[ $(put d/b $WORK/text) == 200 ]] || fail "PUT before the snapshot"
+id=$(curl -s -X POST $URL/ds3-snap/)
+[[ -n $id ]] || fail "no snapshot taken"
+[[ $(put a $WORK/small) == 200 ]] || fail "PUT after the snapshot"
+[[ $(curl -s -o /dev/null -w "%{http_code}" -X POST -d "inodes=1000&data=40000" $URL/ds3-resize/) == 200 ]] \
+    || fail "resize"
+[[ $(curl -s -o /dev/null -w "%{http_code}" -X POST -d "data=99999999999" $URL/ds3-resize/) == 400 ]] \
+    || fail "resize past the limit was accepted"
+same $WORK/small $URL/ds3/a || fail "file changed by the resize"
+same $WORK/text $URL/ds3/d/b || fail "file changed by the resize"
+same $WORK/random $URL/ds3-snap/$id/a || fail "snapshot changed by the resize"
+[[ $(put c $WORK/random) == 200 ]] || fail "PUT after the resize"
+stop
+./ds3fsck $WORK/r.img > /dev/null || fail "ds3fsck after the resize"
+
+echo "replication"
+# three replicas on PORT and the two ports after it
+PEERS=(localhost:$PORT localhost:$((PORT + 1)) localhost:$((PORT + 2)))
+echo "a shared secret" > $WORK/key
+for i in 0 1 2; do
+    ./mkfs -f $WORK/n$i.img -d 256 -i 64 > /dev/null
+    others=$(echo ${PEERS[@]/${PEERS[$i]}} | tr ' ' ',')
+    start_at $((PORT + i)) $WORK/n$i.img -r $others -K $WORK/key
+done
+[[ $(put f $WORK/random) == 200 ]] || fail "replicated PUT"
+same $WORK/random http://localhost:$((PORT + 1))/ds3/f || fail "PUT did not reach the other replicas"
+# a delete would be undone by read repair, so it is refused
+[[ $(curl -s -o /dev/null -w "%{http_code}" -X DELETE $URL/ds3/f) == 400 ]] || fail "replicated DELETE was accepted"
+for i in 0 1 2; do
+    curl -s -H "X-Consistency: all" http://localhost:$((PORT + i))/ds3/f > $WORK/got
+    cmp -s $WORK/random $WORK/got || fail "replica $i lost the file after a refused DELETE"
+done
+# a forged replica header is treated as a client write and still replicated
+curl -s -o /dev/null -X PUT -H "X-Ds3-Replica: 1" --data-binary @$WORK/small $URL/ds3/g
+same $WORK/small http://localhost:$((PORT + 2))/ds3/g || fail "forged replica PUT stayed local"
+# with the other replicas gone, a PUT at consistency all fails but is kept
+stop
+start_at $PORT $WORK/n0.img -r ${PEERS[1]},${PEERS[2]} -K $WORK/key -T 500
+code=$(curl -s -o /dev/null -w "%{http_code}" -X PUT -H "X-Consistency: all" --data-binary @$WORK/text $URL/ds3/f)
+[[ $code == 503 ]] || fail "PUT without enough replicas got $code"
+curl -s -H "X-Consistency: one" $URL/ds3/f > $WORK/got
+cmp -s $WORK/text $WORK/got || fail "a PUT answered with 503 was not kept locally"
+stop
+for i in 0 1 2; do
+    ./ds3fsck $WORK/n$i.img > /dev/null || fail "ds3fsck of replica $i"
+done
+
+echo "hedged reads"
+# the proxy on PORT reads from a replica whose peers are all down, which
+# answers every GET with a quick 503, and from a healthy server
+./mkfs -f $WORK/h0.img -d 256 -i 64 > /dev/null
+./mkfs -f $WORK/h1.img -d 256 -i 64 > /dev/null
+start_at $((PORT + 1)) $WORK/h0.img -r localhost:1,localhost:2 -K $WORK/key
+start_at $((PORT + 2)) $WORK/h1.img
+curl -s -o /dev/null -X PUT --data-binary @$WORK/small http://localhost:$((PORT + 2))/ds3/f
+start_at $PORT $WORK/h0.img -P localhost:$((PORT + 1)),localhost:$((PORT + 2))
+for i in $(seq 10); do
+    same $WORK/small $URL/ds3/f || fail "a 5xx from one peer reached the client"
+done
+grep -q "^failures 0$" <(curl -s "$URL/ds3/?stats=hedge") || fail "proxy counted failures"
+stop
+
+echo "leases"
+./mkfs -f $WORK/l.img -d 256 -i 64 > /dev/null
+start $WORK/l.img -L 60000
+[[ $(put f $WORK/random) == 200 ]] || fail "PUT before the lease"
+curl -s -D $WORK/headers -o /dev/null $URL/ds3/f
+grep -q "^X-Lease: ttl=60000" $WORK/headers || fail "GET granted no lease"
+seq=$(sed -n 's/^X-Lease: .*seq=\([0-9]*\).*/\1/p' $WORK/headers)
+[[ $(curl -s "$URL/ds3/?invalidations=$seq" | sed 1d) == "" ]] || fail "lease revoked before any write"
+[[ $(put f $WORK/small) == 200 ]] || fail "PUT under a lease"
+[[ $(curl -s "$URL/ds3/?invalidations=$seq" | sed 1d) == f ]] || fail "PUT did not revoke the lease"
+stop
+./ds3fsck $WORK/l.img > /dev/null || fail "ds3fsck after the leases"
+
+echo "watch"
+./mkfs -f $WORK/w.img -d 256 -i 64 > /dev/null
+start $WORK/w.img
+[[ $(put d/before $WORK/small) == 200 ]] || fail "PUT before the watch"
+version=$(curl -s -D - -o /dev/null $URL/ds3/d/ | tr -d '\r' | awk '/^X-Watch-Version:/ { print $2 }')
+[[ -n $version ]] || fail "listing carried no watch version"
+curl -s "$URL/ds3/d/?watch=$version&timeout=5000" > $WORK/watched &
+watcher=$!
+sleep 0.5
+[[ $(put elsewhere $WORK/small) == 200 ]] || fail "PUT outside the watched directory"
+[[ $(put d/after $WORK/small) == 200 ]] || fail "PUT in the watched directory"
+wait $watcher
+[[ $(sed 1d $WORK/watched) == d/after ]] || fail "watch returned: $(cat $WORK/watched)"
+stop
+./ds3fsck $WORK/w.img > /dev/null || fail "ds3fsck after the watch"
+
+echo "move"
+./mkfs -f $WORK/mv.img -d 256 -i 64 > /dev/null
+start $WORK/mv.img
+[[ $(put d/f $WORK/random) == 200 ]] || fail "PUT before the move"
+# MOVE $1 to $2, both below /ds3/
+move() {
+    curl -s -o /dev/null -w "%{http_code}" -X MOVE -H "Destination: /ds3/$2" $URL/ds3/$1
+}
+[[ $(move d/f e/g) == 200 ]] || fail "MOVE of a file"
+same $WORK/random $URL/ds3/e/g || fail "moved file read back differently"
+[[ $(curl -s -o /dev/null -w "%{http_code}" $URL/ds3/d/f) == 404 ]] || fail "file still at its old path"
+[[ $(move e d/e) == 200 ]] || fail "MOVE of a directory"
+same $WORK/random $URL/ds3/d/e/g || fail "file in a moved directory read back differently"
+[[ $(move d d/e/d) == 409 ]] || fail "MOVE of a directory into itself"
+[[ $(move missing other) == 404 ]] || fail "MOVE of a missing file"
+stop
+./ds3fsck $WORK/mv.img > /dev/null || fail "ds3fsck after the moves"
+
+echo "copy"
+./mkfs -f $WORK/cp.img -d 256 -i 64 > /dev/null
+start $WORK/cp.img
+[[ $(put f $WORK/random) == 200 ]] || fail "PUT before the copy"
+before=$(used_blocks $WORK/cp.img)
+code=$(curl -s -o /dev/null -w "%{http_code}" -X COPY -H "Destination: /ds3/d/copy" $URL/ds3/f)
+[[ $code == 200 ]] || fail "COPY got $code"
+after=$(used_blocks $WORK/cp.img)
+# the copy shares the data blocks, only its directory needs one
+(( after - before <= 1 )) || fail "a copy of a 100 KB file took $((after - before)) blocks"
+same $WORK/random $URL/ds3/d/copy || fail "copy read back differently"
+[[ $(put d/copy $WORK/text) == 200 ]] || fail "PUT over the copy"
+same $WORK/random $URL/ds3/f || fail "writing the copy changed the source"
+same $WORK/text $URL/ds3/d/copy || fail "overwritten copy read back differently"
+stop
+./ds3fsck $WORK/cp.img > /dev/null || fail "ds3fsck after the copy"
+
+echo "deduplication"
+./mkfs -f $WORK/dd.img -d 256 -i 64 -D > /dev/null
+start $WORK/dd.img
+[[ $(put f $WORK/random) == 200 ]] || fail "PUT of the first copy"
+before=$(used_blocks $WORK/dd.img)
+[[ $(put d/g $WORK/random) == 200 ]] || fail "PUT of identical contents"
+after=$(used_blocks $WORK/dd.img)
+# the index is direct-mapped, so two blocks of the file that share a slot
+# cost a block, but nowhere near the 25 a second copy would take
+(( after - before < 8 )) || fail "identical contents took $((after - before)) more blocks"
+[[ $(put f $WORK/text) == 200 ]] || fail "PUT over a deduplicated file"
+same $WORK/random $URL/ds3/d/g || fail "overwriting one copy changed the other"
+stop
+./ds3fsck $WORK/dd.img > /dev/null || fail "ds3fsck after deduplication"
+
+echo "inline files"
+./mkfs -f $WORK/in.img -d 256 -i 64 > /dev/null
+start $WORK/in.img
+before=$(used_blocks $WORK/in.img)
+[[ $(put d/small $WORK/small) == 200 ]] || fail "PUT of a small file"
+[[ $(used_blocks $WORK/in.img) == $before ]] || fail "a small file and its directory took data blocks"
+same $WORK/small $URL/ds3/d/small || fail "inline file read back differently"
+# growing past the inode moves it to data blocks, shrinking brings it back
+[[ $(put d/small $WORK/random) == 200 ]] || fail "PUT growing an inline file"
+same $WORK/random $URL/ds3/d/small || fail "grown file read back differently"
+[[ $(put d/small $WORK/small) == 200 ]] || fail "PUT shrinking a file"
+[[ $(used_blocks $WORK/in.img) == $before ]] || fail "a shrunk file kept its data blocks"
+same $WORK/small $URL/ds3/d/small || fail "shrunk file read back differently"
+stop
+./ds3fsck $WORK/in.img > /dev/null || fail "ds3fsck after the inline files"
+
+echo "checksums"
+./mkfs -f $WORK/ck.img -d 256 -i 64 -C > /dev/null
+start $WORK/ck.img
+[[ $(put f $WORK/random) == 200 ]] || fail "PUT before the corruption"
+stop
+block=$(file_blocks $WORK/ck.img f | head -1)
+dd if=/dev/urandom of=$WORK/ck.img bs=4096 seek=$block count=1 conv=notrunc 2> /dev/null
+start $WORK/ck.img
+curl -s -o /dev/null $URL/ds3/f
+grep -q "^Checksum mismatch in block $block$" $WORK/server-$PORT.log || fail "corrupt block $block went unnoticed"
+stop
+./ds3fsck $WORK/ck.img > $WORK/fsck && fail "ds3fsck passed a corrupt block"
+grep -q "^block $block doesn't match its checksum$" $WORK/fsck || fail "ds3fsck: $(cat $WORK/fsck)"
+
+echo "ds3fsck repair"
+./mkfs -f $WORK/fs.img -d 256 -i 64 > /dev/null
+start $WORK/fs.img
+[[ $(put f $WORK/random) == 200 ]] || fail "PUT before the damage"
+stop
+# mark eight free data blocks as in use
+bitmap=$(od -An -t d4 -j 8 -N 4 $WORK/fs.img)
+printf '\xff' | dd of=$WORK/fs.img bs=1 seek=$((bitmap * 4096 + 20)) conv=notrunc 2> /dev/null
+./ds3fsck $WORK/fs.img > $WORK/fsck
+[[ $? == 4 ]] || fail "ds3fsck passed a damaged bitmap"
+grep -q "is allocated but unused$" $WORK/fsck || fail "ds3fsck: $(cat $WORK/fsck)"
+./ds3fsck -r $WORK/fs.img > /dev/null
+[[ $? == 1 ]] || fail "ds3fsck -r did not repair the bitmap"
+./ds3fsck $WORK/fs.img > /dev/null || fail "damage left after ds3fsck -r"
+start $WORK/fs.img
+same $WORK/random $URL/ds3/f || fail "file changed by the repair"
+stop
+
+echo "defragmentation"
+# one-block files fill the image, freeing every other one leaves only
+# one-block holes for the file, and freeing the rest leaves room to move it
+./mkfs -f $WORK/df.img -d 128 -i 128 > /dev/null
+head -c 4096 /dev/urandom > $WORK/block
+head -c 80000 /dev/urandom > $WORK/filler
+head -c 120000 /dev/urandom > $WORK/big
+start $WORK/df.img
+for i in $(seq 64); do
+    [[ $(put s$i $WORK/block) == 200 ]] || fail "PUT of a one-block file"
+done
+for i in 1 2 3; do
+    [[ $(put filler$i $WORK/filler) == 200 ]] || fail "PUT of a filler file"
+done
+for i in $(seq 1 2 64); do
+    curl -s -o /dev/null -X DELETE $URL/ds3/s$i
+done
+[[ $(put big $WORK/big) == 200 ]] || fail "PUT into the holes"
+for i in $(seq 2 2 64); do
+    curl -s -o /dev/null -X DELETE $URL/ds3/s$i
+done
+for i in 1 2 3; do
+    curl -s -o /dev/null -X DELETE $URL/ds3/filler$i
+done
+stop
+contiguous $WORK/df.img big && fail "the file was not fragmented to begin with"
+start $WORK/df.img -F 10000
+for i in $(seq 50); do
+    contiguous $WORK/df.img big && break
+    sleep 0.1
+done
+contiguous $WORK/df.img big || fail "the defragmenter left the file fragmented"
+same $WORK/big $URL/ds3/big || fail "defragmented file read back differently"
+stop
+./ds3fsck $WORK/df.img > /dev/null || fail "ds3fsck after defragmenting"
+
+echo "undo log across savepoints"
+# many operations on the same blocks in one batch, with a failure between
+# them that must undo only its own writes
+./mkfs -f $WORK/u.img -d 256 -i 32 > /dev/null
+start $WORK/u.img
+: > $WORK/batch
+for i in $(seq 200); do
+    printf 'PUT d/f 6\n%06d\n' $i >> $WORK/batch
+done
+printf 'PUT %s 4\nfail\nPUT d/f 4\nlast\n' $(seq -s / 40)/file >> $WORK/batch
+curl -s -X POST --data-binary @$WORK/batch $URL/ds3/ > $WORK/result
+[[ $(grep -c "^200 d/f$" $WORK/result) == 201 ]] || fail "batch: $(sort $WORK/result | uniq -c)"
+grep -q "^507 " $WORK/result || fail "the deep PUT did not fail"
+[[ $(curl -s $URL/ds3/d/f) == last ]] || fail "operations after the failure were lost"
+stop
+./ds3fsck $WORK/u.img > /dev/null || fail "ds3fsck after the batch"
+
+echo "allocation in runs"
+# a new file skips one-block holes for a run that holds all of it
+./mkfs -f $WORK/al.img -d 256 -i 64 > /dev/null
+start $WORK/al.img
+for i in $(seq 16); do
+    [[ $(put s$i $WORK/block) == 200 ]] || fail "PUT of a one-block file"
+done
+for i in $(seq 1 2 16); do
+    curl -s -o /dev/null -X DELETE $URL/ds3/s$i
+done
+[[ $(put big $WORK/big) == 200 ]] || fail "PUT next to the holes"
+stop
+contiguous $WORK/al.img big || fail "a new file was split over the holes"
+./ds3fsck $WORK/al.img > /dev/null || fail "ds3fsck after allocating"
+
+echo "all passed"